@@ -0,0 +1,62 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#pragma once
+
+#include <stddef.h>
+
+// A region of memory that is freed at once.
+//
+// Allocations are carved out of blocks, which double in size up to a limit, so
+// small arenas stay small and large ones only hold a handful of blocks. Nothing
+// allocated from an arena is freed on its own.
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock *head;
+} Arena;
+
+void arena_init(Arena *arena);
+
+// Free every allocation of an arena.
+void arena_free(Arena *arena);
+
+// Allocate memory aligned for any type.
+void *arena_alloc(Arena *arena, size_t size);
+
+char *arena_strdup(Arena *arena, const char *str);
+
+// Grow an allocation of `size` bytes to `new_size` bytes.
+//
+// The allocation is extended in place when it is the last one of the arena,
+// otherwise it is copied and the old memory is left unused.
+void *arena_grow(Arena *arena, void *data, size_t size, size_t new_size);
+
+// Push to a `Vec` whose data is allocated from an arena.
+#define arena_push(arena, vec, elem)                                           \
+    do {                                                                       \
+        if ((vec)->len == (vec)->cap) {                                        \
+            size_t __arena_cap = (vec)->cap ? (vec)->cap * 2 : 4;              \
+            (vec)->data = arena_grow(arena, (vec)->data,                       \
+                                     sizeof(*(vec)->data) * (vec)->cap,        \
+                                     sizeof(*(vec)->data) * __arena_cap);      \
+            (vec)->cap = __arena_cap;                                          \
+        }                                                                      \
+        (vec)->data[(vec)->len++] = elem;                                      \
+    } while (0)
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
@@ -24,6 +24,13 @@ typedef struct Build {
 
     // The targets of the build.
     Targets targets;
+
+    // The arena of a deserialized build, or empty.
+    //
+    // The serialized data, the targets and their vectors are allocated from
+    // it, so the whole build is freed at once. The targets of a deserialized
+    // build must not be modified.
+    Arena arena;
 } Build;
 
 // Initialize a build.
@@ -36,11 +43,18 @@ void build_free(Build *build);
 Target *build_push_target(Build *build, Target target);
 
 // Serialize a build to a file.
-void serialize_build(const Build *build, FILE *file);
+bool serialize_build(const Build *build, FILE *file);
 
 // Deserialize a build from a file.
+//
+// The header is read first, and then the rest of the build at once.
 bool deserialize_build(Build *build, FILE *file);
 
+// Deserialize a build from the data following the header, see `serialize.h`.
+//
+// The data is copied into the arena of the build.
+bool deserialize_build_data(Build *build, const void *data, size_t size);
+
 // This file is part of Lute.
 // Copyright (C) 2024  Hjalte C. Nannestad
 //
@@ -10,9 +10,31 @@ Target *target(Build *build, const char *name, Output kind);
 
 // Add a source file to a target.
 //
-// If the path is a directory, all files in the directory are added recursively.
+// If the path is a directory, all source files in the directory are added
+// recursively.
 void source(Target *target, const char *path);
 
+// Add the files matching a glob pattern to a target.
+//
+// `*`, `?` and `[...]` match within a segment of the pattern, and a `**`
+// segment matches any number of directories, eg. `src/**/*.cc`. The pattern is
+// followed by patterns of files and directories to leave out, and a NULL:
+//
+//     source_glob(t, "src/**/*.cc", "src/vendor", "src/**/test", NULL);
+//
+// Excludes must be inside the directory the pattern starts from. Directories
+// that are excluded, or cannot hold a match, are never read. A file named
+// without wildcards is added whatever its extension, a directory is added like
+// with `source`.
+void source_glob(Target *target, const char *pattern, ...)
+    __attribute__((sentinel));
+
+// Add an extension of source files to a target, eg. `.cc`.
+//
+// The first extension replaces the defaults, `.c` and `.cpp`. Only files with
+// these extensions are added from directories passed to `source`.
+void extension(Target *target, const char *ext);
+
 // Add an include path to a target.
 void include(Target *target, const char *path);
 
@@ -4,16 +4,77 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
-#define serialize_data(data, file) fwrite(data, sizeof(*(data)), 1, file)
-#define deserialize_data(data, file) fread(data, sizeof(*(data)), 1, file)
+#include "arena.h"
+#include "vector.h"
 
-// Serialize a string to a file.
-void serialize_str(const char *string, FILE *file);
+// The serialized format of a build.
+//
+// header:  char magic[8], u32 version, u32 size
+// strings: u32 size, char data[size], null padded to a multiple of 4
+// body:    u32 fields
+//
+// `size` is the number of bytes following the header, so the rest can be read
+// at once. Every field is a native-endian u32. Strings are null terminated and
+// stored once in the string table, and referred to by their offset into it.
+#define SERIALIZE_MAGIC "LUTEBILD"
+#define SERIALIZE_VERSION 2
+#define SERIALIZE_HEADER_SIZE 16
+
+// The reference of a NULL string.
+#define SERIALIZE_NULL UINT32_MAX
+
+typedef struct Serializer {
+    Vec(char) strings;
+    Vec(uint32_t) body;
+
+    // Open addressing table of string offsets + 1, 0 is an empty slot.
+    uint32_t *table;
+    size_t table_len;
+    size_t table_cap;
+} Serializer;
+
+void serializer_init(Serializer *serializer);
+void serializer_free(Serializer *serializer);
+
+// Serialize a field.
+void serialize_u32(Serializer *serializer, uint32_t value);
+
+// Serialize a string, which may be NULL.
+void serialize_str(Serializer *serializer, const char *string);
+
+// Write the header, string table and body to a file at once.
+bool serializer_write(const Serializer *serializer, FILE *file);
+
+typedef struct Deserializer {
+    const uint32_t *body;
+    size_t len;
+    size_t pos;
+
+    const char *strings;
+    size_t strings_size;
+
+    // Cleared when anything is malformed.
+    bool ok;
+
+    // Where deserialized targets and their vectors are allocated.
+    Arena *arena;
+} Deserializer;
+
+// Start deserializing everything following the header.
+bool deserializer_init(Deserializer *deserializer, const void *data,
+                       size_t size, Arena *arena);
+
+// Read the header, returns the size of the rest or 0 if it is invalid.
+size_t deserialize_header(const void *header);
+
+uint32_t deserialize_u32(Deserializer *deserializer);
 
-// Deserialize a string from a file.
-bool deserialize_str(char **string, FILE *file);
+// Deserialize a string, which points into the string table.
+char *deserialize_str(Deserializer *deserializer);
 
 // This file is part of Lute.
 // Copyright (C) 2024  Hjalte C. Nannestad
@@ -6,6 +6,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#include "serialize.h"
 #include "vector.h"
 
 // Outputs of a target.
@@ -114,21 +115,45 @@ void dep_init(Dep *dep, const char *name, const char *target);
 // Free a dependency.
 void dep_free(Dep *dep);
 
-// Serialize a dependency to a file.
-void serialize_dep(const Dep *dep, FILE *file);
+// Serialize a dependency.
+void serialize_dep(const Dep *dep, Serializer *serializer);
 
-// Deserialize a dependency from a file.
-bool deserialize_dep(Dep *dep, FILE *file);
+// Deserialize a dependency, its strings point into the serialized data.
+bool deserialize_dep(Dep *dep, Deserializer *deserializer);
 
 // Free a list of dependencies.
 void deps_free(Deps *deps);
 
-// Deserialize a list of dependencies from a file.
-bool deserialize_deps(Deps *deps, FILE *file);
-
 // A list of strings.
 typedef Vec(char *) Strings;
 
+// A source of a target.
+typedef struct Source {
+    // The real path of the file or directory.
+    char *path;
+
+    // The pattern files in the directory must match, relative to it.
+    //
+    // If NULL, every file with a source extension is added.
+    char *pattern;
+
+    // Patterns of files and directories to leave out, relative to the
+    // directory. Excluded directories are not read.
+    Strings excludes;
+} Source;
+
+// A list of sources.
+typedef Vec(Source) Sources;
+
+// Free a source.
+void source_free(Source *source);
+
+// Serialize a source.
+void serialize_source(const Source *source, Serializer *serializer);
+
+// Deserialize a source, its strings point into the serialized data.
+bool deserialize_source(Source *source, Deserializer *deserializer);
+
 // A build target.
 typedef struct Target {
     // The name of the target.
@@ -157,7 +182,12 @@ typedef struct Target {
     // The sources of the target.
     //
     // Do not interact with this directly.
-    Strings sources;
+    Sources sources;
+
+    // The extensions of source files, eg. `.c`.
+    //
+    // If empty, `.c` and `.cpp` files are sources.
+    Strings extensions;
 
     // The includes of the target.
     //
@@ -182,13 +212,16 @@ bool is_valid_target_name(const char *name);
 bool target_init(Target *target, const char *name, Output kind);
 void target_free(Target *target);
 
-void serialize_target(const Target *target, FILE *file);
-bool deserialize_target(Target *target, FILE *file);
+void serialize_target(const Target *target, Serializer *serializer);
+
+// Deserialized targets and their vectors are allocated from the arena of the
+// deserializer, and their strings point into the serialized data.
+bool deserialize_target(Target *target, Deserializer *deserializer);
 
 void targets_free(Targets *targets);
 
-void serialize_targets(const Targets *targets, FILE *file);
-bool deserialize_targets(Targets *targets, FILE *file);
+void serialize_targets(const Targets *targets, Serializer *serializer);
+bool deserialize_targets(Targets *targets, Deserializer *deserializer);
 
 // This file is part of Lute.
 // Copyright (C) 2024  Hjalte C. Nannestad
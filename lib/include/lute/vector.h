@@ -47,6 +47,49 @@
         (vec)->data[(vec)->len++] = elem;                                      \
     } while (0)
 
+// Make room for at least `n` elements in total, so pushing up to that many
+// does not reallocate.
+#define vec_reserve(vec, n)                                                    \
+    do {                                                                       \
+        size_t __vec_n = (n);                                                  \
+        if (__vec_n > (vec)->cap) {                                            \
+            (vec)->cap = __vec_n;                                              \
+            (vec)->data =                                                      \
+                realloc((vec)->data, __vec_elem_size(vec) * (vec)->cap);       \
+        }                                                                      \
+    } while (0)
+
+// Append `n` elements from an array at once.
+//
+// `elems` and `n` are evaluated once, before the vector grows. The array may be
+// part of the vector itself, eg. `vec_extend(vec, vec)`.
+#define vec_append(vec, elems, n)                                              \
+    do {                                                                       \
+        const char *__vec_src = (const char *)(elems);                         \
+        size_t __vec_count = (n);                                              \
+        size_t __vec_size = __vec_elem_size(vec);                              \
+        size_t __vec_len = (vec)->len + __vec_count;                           \
+        if (__vec_len > (vec)->cap) {                                          \
+            const char *__vec_old = (const char *)(vec)->data;                 \
+            size_t __vec_cap = (vec)->cap * 2 + 1;                             \
+            int __vec_own = __vec_old && __vec_src >= __vec_old &&             \
+                            __vec_src < __vec_old + __vec_size * (vec)->len;   \
+            size_t __vec_offset = __vec_own ? __vec_src - __vec_old : 0;       \
+            vec_reserve(vec, __vec_len > __vec_cap ? __vec_len : __vec_cap);   \
+            if (__vec_own) {                                                   \
+                __vec_src = (const char *)(vec)->data + __vec_offset;          \
+            }                                                                  \
+        }                                                                      \
+        if (__vec_count > 0) {                                                 \
+            memcpy((vec)->data + (vec)->len, __vec_src,                        \
+                   __vec_size * __vec_count);                                  \
+        }                                                                      \
+        (vec)->len = __vec_len;                                                \
+    } while (0)
+
+// Append every element of another vector.
+#define vec_extend(vec, other) vec_append(vec, (other)->data, (other)->len)
+
 #define vec_foreach(vec, elem)                                                 \
     size_t __vec_i = 0;                                                        \
     for (typeof(*(vec)->data) elem;                                            \
@@ -59,28 +102,176 @@
          __vec_i < (vec)->len && ((elem) = &(vec)->data[__vec_i], 1);          \
          __vec_i++)
 
+// A string built by appending to it.
+//
+// Appending is amortized linear in the length of the appended string,
+// regardless of how long the string already is.
+typedef Vec(char) StringBuilder;
+
+#define string_builder_init(builder) vec_init(builder)
+#define string_builder_free(builder) vec_free(builder)
+
+static inline void string_builder_append_len(StringBuilder *builder,
+                                             const char *str, size_t len) {
+    vec_append(builder, str, len);
+}
+
+static inline void string_builder_append(StringBuilder *builder,
+                                         const char *str) {
+    string_builder_append_len(builder, str, strlen(str));
+}
+
+// Take the built string, which must be freed. The builder is left empty.
+static inline char *string_builder_finish(StringBuilder *builder) {
+    vec_push(builder, '\0');
+
+    char *str = builder->data;
+    vec_init(builder);
+
+    return str;
+}
+
 #define vec_join(vec, sep) __vec_join((vec)->data, (vec)->len, sep)
 
-inline char *__vec_join(const char **data, size_t len, const char *sep) {
-    char *str = NULL;
-    size_t new_len = 0;
+static inline char *__vec_join(const char **data, size_t len, const char *sep) {
+    size_t sep_len = strlen(sep);
+    size_t total = 1;
 
     for (size_t i = 0; i < len; i++) {
-        new_len += strlen(data[i]) + strlen(sep);
+        total += strlen(data[i]) + (i > 0 ? sep_len : 0);
     }
 
-    str = malloc(new_len + 1);
-    str[0] = '\0';
+    StringBuilder builder;
+    string_builder_init(&builder);
+    vec_reserve(&builder, total);
 
     for (size_t i = 0; i < len; i++) {
-        strcat(str, data[i]);
+        if (i > 0) {
+            string_builder_append_len(&builder, sep, sep_len);
+        }
+
+        string_builder_append(&builder, data[i]);
+    }
+
+    return string_builder_finish(&builder);
+}
+
+// A hash map from strings to values.
+//
+// The map does not own its keys, they must outlive their entries. Entries are
+// stored inline with open addressing, so lookups touch a single array.
+#define Map(type)                                                              \
+    struct {                                                                   \
+        struct {                                                               \
+            const char *key;                                                   \
+            size_t hash;                                                       \
+            type value;                                                        \
+        } *data;                                                               \
+        size_t len;                                                            \
+        size_t cap;                                                            \
+    }
 
-        if (i < len - 1) {
-            strcat(str, sep);
+#define map_init(map) vec_init(map)
+#define map_free(map) vec_free(map)
+
+#define __map_entry_size(map) sizeof(*(map)->data)
+#define __map_value_offset(map) offsetof(typeof(*(map)->data), value)
+
+// Get a pointer to the value of a key, or NULL if it is not in the map.
+#define map_get(map, key)                                                      \
+    ((typeof(&(map)->data->value))__map_get((map)->data, (map)->cap,           \
+                                            __map_entry_size(map),            \
+                                            __map_value_offset(map), key))
+
+// Set the value of a key. The key is evaluated more than once.
+#define map_put(map, k, v)                                                     \
+    do {                                                                       \
+        if (((map)->len + 1) * 4 > (map)->cap * 3) {                           \
+            __map_grow((void **)&(map)->data, &(map)->cap,                     \
+                       __map_entry_size(map));                                 \
+        }                                                                      \
+        size_t __map_h = __map_hash(k);                                        \
+        size_t __map_s = __map_slot((map)->data, (map)->cap,                   \
+                                    __map_entry_size(map), k, __map_h);        \
+        if (!(map)->data[__map_s].key) {                                       \
+            (map)->data[__map_s].key = (k);                                    \
+            (map)->data[__map_s].hash = __map_h;                               \
+            (map)->len++;                                                      \
+        }                                                                      \
+        (map)->data[__map_s].value = (v);                                      \
+    } while (0)
+
+// Iterate over the entries of a map, in no particular order.
+#define map_foreach(map, entry)                                                \
+    size_t __vec_i = 0;                                                        \
+    for (typeof(*(map)->data) *entry; __vec_i < (map)->cap; __vec_i++)         \
+        if (((entry) = &(map)->data[__vec_i])->key)
+
+static inline size_t __map_hash(const char *key) {
+    size_t hash = 0xcbf29ce484222325ull;
+
+    for (; *key; key++) {
+        hash ^= (unsigned char)*key;
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+// Find the slot of a key, or the empty slot it would be put in.
+static inline size_t __map_slot(const void *data, size_t cap, size_t size,
+                                const char *key, size_t hash) {
+    size_t mask = cap - 1;
+
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const char *entry = (const char *)data + i * size;
+        const char *entry_key = *(const char *const *)entry;
+
+        if (!entry_key ||
+            (*(const size_t *)(entry + sizeof(char *)) == hash &&
+             strcmp(entry_key, key) == 0)) {
+            return i;
         }
     }
+}
 
-    return str;
+static inline void *__map_get(void *data, size_t cap, size_t size,
+                              size_t offset, const char *key) {
+    if (cap == 0) {
+        return NULL;
+    }
+
+    char *entry =
+        (char *)data + __map_slot(data, cap, size, key, __map_hash(key)) * size;
+
+    return *(char **)entry ? entry + offset : NULL;
+}
+
+static inline void __map_grow(void **data, size_t *cap, size_t size) {
+    size_t new_cap = *cap ? *cap * 2 : 16;
+    char *new_data = calloc(new_cap, size);
+
+    for (size_t i = 0; i < *cap; i++) {
+        char *entry = (char *)*data + i * size;
+
+        if (!*(char **)entry) {
+            continue;
+        }
+
+        // keys are unique, so only an empty slot is needed
+        size_t hash = *(size_t *)(entry + sizeof(char *));
+        size_t slot = hash & (new_cap - 1);
+
+        while (*(char **)(new_data + slot * size)) {
+            slot = (slot + 1) & (new_cap - 1);
+        }
+
+        memcpy(new_data + slot * size, entry, size);
+    }
+
+    free(*data);
+    *data = new_data;
+    *cap = new_cap;
 }
 
 // This file is part of Lute.
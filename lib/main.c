@@ -3,17 +3,20 @@
 void build(Build *build);
 
 int main(int argc, char **argv) {
-    (void)argc;
-    (void)argv;
-
     Build b;
     build_init(&b);
 
     build(&b);
 
-    serialize_build(&b, stdout);
+    // lute passes the file to write the build to, stdout is left to the build
+    FILE *file = argc > 1 ? fopen(argv[1], "wb") : stdout;
+    bool success = file && serialize_build(&b, file);
+
+    if (file && file != stdout && fclose(file) != 0) {
+        success = false;
+    }
 
     build_free(&b);
 
-    return 0;
+    return success ? 0 : 1;
 }
@@ -0,0 +1,119 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lute/arena.h>
+
+#define ARENA_BLOCK_MIN 256
+#define ARENA_BLOCK_MAX (64 * 1024)
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size;
+    size_t used;
+
+    alignas(max_align_t) char data[];
+};
+
+void arena_init(Arena *arena) { arena->head = NULL; }
+
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->head;
+
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->head = NULL;
+}
+
+static size_t arena_align(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size = arena_align(size ? size : 1);
+
+    ArenaBlock *head = arena->head;
+
+    if (head && head->size - head->used >= size) {
+        void *data = head->data + head->used;
+        head->used += size;
+        return data;
+    }
+
+    size_t block_size = head ? head->size * 2 : ARENA_BLOCK_MIN;
+
+    if (block_size > ARENA_BLOCK_MAX) {
+        block_size = ARENA_BLOCK_MAX;
+    }
+
+    // a large allocation gets a block of its own, behind the current one so
+    // its free space is still used
+    bool own = size > block_size;
+
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + (own ? size : block_size));
+    block->size = own ? size : block_size;
+    block->used = size;
+
+    if (own && head) {
+        block->next = head->next;
+        head->next = block;
+    } else {
+        block->next = head;
+        arena->head = block;
+    }
+
+    return block->data;
+}
+
+char *arena_strdup(Arena *arena, const char *str) {
+    size_t size = strlen(str) + 1;
+    return memcpy(arena_alloc(arena, size), str, size);
+}
+
+void *arena_grow(Arena *arena, void *data, size_t size, size_t new_size) {
+    ArenaBlock *head = arena->head;
+
+    if (data && head && (char *)data + arena_align(size) ==
+                            head->data + head->used) {
+        size_t start = (char *)data - head->data;
+
+        if (head->size - start >= new_size) {
+            head->used = start + arena_align(new_size);
+            return data;
+        }
+    }
+
+    void *new_data = arena_alloc(arena, new_size);
+
+    if (size) {
+        memcpy(new_data, data, size);
+    }
+
+    return new_data;
+}
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
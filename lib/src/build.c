@@ -3,6 +3,7 @@
 
 #include <dirent.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 
 #include <lute/build.h>
@@ -13,11 +14,18 @@ void build_init(Build *build) {
     build->lang = C;
     build->warn = Wall | Wextra;
     build->std = 0;
+    arena_init(&build->arena);
 
     vec_init(&build->targets);
 }
 
 void build_free(Build *build) {
+    if (build->arena.head) {
+        arena_free(&build->arena);
+        vec_init(&build->targets);
+        return;
+    }
+
     vec_foreach(&build->targets, target) {
         target_free(target);
         free(target);
@@ -33,20 +41,63 @@ Target *build_push_target(Build *build, Target target) {
     return new_target;
 }
 
-void serialize_build(const Build *build, FILE *file) {
-    serialize_targets(&build->targets, file);
+bool serialize_build(const Build *build, FILE *file) {
+    Serializer serializer;
+    serializer_init(&serializer);
+
+    serialize_targets(&build->targets, &serializer);
+
+    bool success = serializer_write(&serializer, file);
+    serializer_free(&serializer);
+
+    return success;
+}
+
+// Deserialize the targets of a build from data in its arena.
+static bool deserialize_build_arena(Build *build, const void *data,
+                                    size_t size) {
+    Deserializer deserializer;
+
+    if (!deserializer_init(&deserializer, data, size, &build->arena) ||
+        !deserialize_targets(&build->targets, &deserializer)) {
+        build_free(build);
+        return false;
+    }
+
+    return true;
+}
+
+bool deserialize_build_data(Build *build, const void *data, size_t size) {
+    build_init(build);
+
+    void *copy = memcpy(arena_alloc(&build->arena, size), data, size);
+
+    return deserialize_build_arena(build, copy, size);
 }
 
 bool deserialize_build(Build *build, FILE *file) {
-    *build = (Build){0};
+    build_init(build);
+
+    char header[SERIALIZE_HEADER_SIZE];
 
-    bool success = deserialize_targets(&build->targets, file);
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)) {
+        return false;
+    }
 
-    if (!success) {
+    size_t size = deserialize_header(header);
+
+    if (!size) {
+        return false;
+    }
+
+    void *data = arena_alloc(&build->arena, size);
+
+    if (fread(data, 1, size, file) != size) {
         build_free(build);
+        return false;
     }
 
-    return success;
+    return deserialize_build_arena(build, data, size);
 }
 
 // This file is part of Lute.
@@ -1,6 +1,11 @@
 // Copyright (C) 2024  Hjalte C. Nannestad
 // See end of file for license information.
 
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
 #include <lute/lute.h>
 
 Target *target(Build *b, const char *name, Output kind) {
@@ -15,16 +20,144 @@ Target *target(Build *b, const char *name, Output kind) {
 }
 
 void source(Target *t, const char *path) {
-    char *source = realpath(path, NULL);
+    Source source = {.path = realpath(path, NULL), .pattern = NULL};
 
-    if (!source) {
+    if (!source.path) {
         fprintf(stderr, "Error: Could not find source file %s\n", path);
         exit(1);
     }
 
+    vec_init(&source.excludes);
     vec_push(&t->sources, source);
 }
 
+// Drop the empty and `.` segments of a pattern, keeping a leading slash.
+static char *normalize_pattern(const char *pattern) {
+    StringBuilder builder;
+    string_builder_init(&builder);
+
+    if (*pattern == '/') {
+        string_builder_append(&builder, "/");
+    }
+
+    char *copy = strdup(pattern);
+    char *cursor = copy;
+    char *segment;
+
+    while ((segment = strsep(&cursor, "/"))) {
+        if (!*segment || strcmp(segment, ".") == 0) {
+            continue;
+        }
+
+        if (builder.len && builder.data[builder.len - 1] != '/') {
+            string_builder_append(&builder, "/");
+        }
+
+        string_builder_append(&builder, segment);
+    }
+
+    free(copy);
+
+    return string_builder_finish(&builder);
+}
+
+// The length of the leading segments of a pattern without wildcards.
+static size_t pattern_base_len(const char *pattern) {
+    size_t len = 0;
+    const char *segment = pattern;
+
+    while (true) {
+        size_t segment_len = strcspn(segment, "/");
+
+        if (strcspn(segment, "*?[") < segment_len) {
+            return len;
+        }
+
+        len = segment + segment_len - pattern;
+
+        if (!segment[segment_len]) {
+            return len;
+        }
+
+        segment += segment_len + 1;
+    }
+}
+
+// Make an exclude relative to the base of a pattern, or NULL if it is not
+// inside of it.
+static const char *exclude_in_base(const char *exclude, const char *pattern,
+                                   size_t base_len) {
+    if (base_len == 0) {
+        bool absolute = *pattern == '/';
+        return (*exclude == '/') == absolute && exclude[absolute]
+                   ? exclude + absolute
+                   : NULL;
+    }
+
+    return strncmp(exclude, pattern, base_len) == 0 && exclude[base_len] == '/'
+               ? exclude + base_len + 1
+               : NULL;
+}
+
+void source_glob(Target *t, const char *pattern, ...) {
+    char *normal = normalize_pattern(pattern);
+    size_t base_len = pattern_base_len(normal);
+    struct stat st;
+
+    // a file without wildcards is matched by name in its directory, so it is
+    // added whatever its extension
+    if (!normal[base_len] && stat(normal, &st) == 0 && !S_ISDIR(st.st_mode)) {
+        char *slash = strrchr(normal, '/');
+        base_len = slash ? (size_t)(slash - normal) : 0;
+    }
+
+    const char *rest = normal + base_len + (normal[base_len] == '/');
+    char *base = base_len ? strndup(normal, base_len)
+                          : strdup(*normal == '/' ? "/" : ".");
+
+    Source source = {
+        .path = realpath(base, NULL),
+        .pattern = *rest ? strdup(rest) : NULL,
+    };
+
+    if (!source.path) {
+        fprintf(stderr, "Error: Could not find source %s\n", base);
+        exit(1);
+    }
+
+    free(base);
+    vec_init(&source.excludes);
+
+    va_list excludes;
+    va_start(excludes, pattern);
+
+    const char *exclude;
+
+    while ((exclude = va_arg(excludes, const char *))) {
+        char *normal_exclude = normalize_pattern(exclude);
+        const char *rel = exclude_in_base(normal_exclude, normal, base_len);
+
+        if (!rel) {
+            fprintf(stderr, "Error: Exclude %s is not inside the base of %s\n",
+                    exclude, pattern);
+            exit(1);
+        }
+
+        vec_push(&source.excludes, strdup(rel));
+        free(normal_exclude);
+    }
+
+    va_end(excludes);
+    free(normal);
+
+    vec_push(&t->sources, source);
+}
+
+void extension(Target *t, const char *ext) {
+    char *extension = strdup(ext);
+    vec_push(&t->extensions, extension);
+}
+
 void include(Target *t, const char *path) {
     char *include = realpath(path, NULL);
     vec_push(&t->includes, include);
@@ -7,44 +7,212 @@
 
 #include <lute/serialize.h>
 
-void serialize_str(const char *string, FILE *file) {
+void serializer_init(Serializer *serializer) {
+    vec_init(&serializer->strings);
+    vec_init(&serializer->body);
+
+    serializer->table = NULL;
+    serializer->table_len = 0;
+    serializer->table_cap = 0;
+}
+
+void serializer_free(Serializer *serializer) {
+    vec_free(&serializer->strings);
+    vec_free(&serializer->body);
+    free(serializer->table);
+}
+
+void serialize_u32(Serializer *serializer, uint32_t value) {
+    vec_push(&serializer->body, value);
+}
+
+static size_t string_hash(const char *string) {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (; *string; string++) {
+        hash ^= (uint8_t)*string;
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
+
+static size_t serializer_slot(const Serializer *serializer,
+                              const char *string) {
+    size_t mask = serializer->table_cap - 1;
+    size_t slot = string_hash(string) & mask;
+
+    while (serializer->table[slot]) {
+        const char *other =
+            serializer->strings.data + serializer->table[slot] - 1;
+
+        if (strcmp(other, string) == 0)
+            break;
+
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+static void serializer_grow(Serializer *serializer) {
+    uint32_t *table = serializer->table;
+    size_t cap = serializer->table_cap;
+
+    serializer->table_cap = cap ? cap * 2 : 64;
+    serializer->table = calloc(serializer->table_cap, sizeof(uint32_t));
+
+    for (size_t i = 0; i < cap; i++) {
+        if (table[i]) {
+            const char *string = serializer->strings.data + table[i] - 1;
+            serializer->table[serializer_slot(serializer, string)] = table[i];
+        }
+    }
+
+    free(table);
+}
+
+void serialize_str(Serializer *serializer, const char *string) {
     if (!string) {
-        int32_t null = -1;
-        serialize_data(&null, file);
+        serialize_u32(serializer, SERIALIZE_NULL);
         return;
     }
 
-    int32_t len = strlen(string);
-    serialize_data(&len, file);
-    fwrite(string, sizeof(char), len, file);
+    if ((serializer->table_len + 1) * 2 > serializer->table_cap) {
+        serializer_grow(serializer);
+    }
+
+    size_t slot = serializer_slot(serializer, string);
+
+    // every string is only stored once
+    if (!serializer->table[slot]) {
+        uint32_t offset = serializer->strings.len;
+
+        vec_append(&serializer->strings, string, strlen(string) + 1);
+
+        serializer->table[slot] = offset + 1;
+        serializer->table_len++;
+    }
+
+    serialize_u32(serializer, serializer->table[slot] - 1);
 }
 
-bool deserialize_str(char **string, FILE *file) {
-    int32_t len;
-    if (!deserialize_data(&len, file)) {
-        return false;
+bool serializer_write(const Serializer *serializer, FILE *file) {
+    uint32_t strings_size = serializer->strings.len;
+    uint32_t padding = (4 - strings_size % 4) % 4;
+    uint32_t body_size = serializer->body.len * sizeof(uint32_t);
+
+    uint32_t version = SERIALIZE_VERSION;
+    uint32_t size = sizeof(uint32_t) + strings_size + padding + body_size;
+
+    char header[SERIALIZE_HEADER_SIZE];
+    memcpy(header, SERIALIZE_MAGIC, 8);
+    memcpy(header + 8, &version, sizeof(version));
+    memcpy(header + 12, &size, sizeof(size));
+
+    char *data = malloc(SERIALIZE_HEADER_SIZE + size);
+    char *ptr = data;
+
+    memcpy(ptr, header, sizeof(header));
+    ptr += sizeof(header);
+    memcpy(ptr, &strings_size, sizeof(strings_size));
+    ptr += sizeof(strings_size);
+    memcpy(ptr, serializer->strings.data, strings_size);
+    ptr += strings_size;
+    memset(ptr, 0, padding);
+    ptr += padding;
+    memcpy(ptr, serializer->body.data, body_size);
+
+    bool success =
+        fwrite(data, 1, SERIALIZE_HEADER_SIZE + size, file) ==
+        SERIALIZE_HEADER_SIZE + size;
+
+    free(data);
+
+    return success && fflush(file) == 0;
+}
+
+size_t deserialize_header(const void *header) {
+    const char *bytes = header;
+
+    uint32_t version;
+    uint32_t size;
+    memcpy(&version, bytes + 8, sizeof(version));
+    memcpy(&size, bytes + 12, sizeof(size));
+
+    if (memcmp(bytes, SERIALIZE_MAGIC, 8) != 0) {
+        fprintf(stderr, "Error: Build output is not a serialized build\n");
+        return 0;
     }
 
-    if (len == -1) {
-        *string = NULL;
-        return true;
+    if (version != SERIALIZE_VERSION) {
+        fprintf(stderr,
+                "Error: Build was serialized with version %u, expected %u\n",
+                version, SERIALIZE_VERSION);
+        return 0;
     }
 
-    *string = malloc(len + 1);
-    if (!*string) {
+    return size;
+}
+
+bool deserializer_init(Deserializer *deserializer, const void *data,
+                       size_t size, Arena *arena) {
+    const char *bytes = data;
+    uint32_t strings_size;
+
+    deserializer->ok = false;
+    deserializer->arena = arena;
+
+    if (size < sizeof(strings_size) || size % 4 != 0) {
         return false;
     }
 
-    if (fread(*string, sizeof(char), len, file) != (size_t)len) {
-        free(*string);
+    memcpy(&strings_size, bytes, sizeof(strings_size));
+
+    size_t padded = (strings_size + 3) / 4 * 4;
+
+    // strings must be terminated, so they can be used in place
+    if (padded > size - sizeof(strings_size) ||
+        (strings_size && bytes[sizeof(strings_size) + strings_size - 1])) {
         return false;
     }
 
-    (*string)[len] = '\0';
+    deserializer->strings = bytes + sizeof(strings_size);
+    deserializer->strings_size = strings_size;
+    deserializer->body =
+        (const uint32_t *)(bytes + sizeof(strings_size) + padded);
+    deserializer->len = (size - sizeof(strings_size) - padded) / 4;
+    deserializer->pos = 0;
+    deserializer->ok = true;
 
     return true;
 }
 
+uint32_t deserialize_u32(Deserializer *deserializer) {
+    if (!deserializer->ok || deserializer->pos >= deserializer->len) {
+        deserializer->ok = false;
+        return 0;
+    }
+
+    return deserializer->body[deserializer->pos++];
+}
+
+char *deserialize_str(Deserializer *deserializer) {
+    uint32_t offset = deserialize_u32(deserializer);
+
+    if (!deserializer->ok || offset == SERIALIZE_NULL) {
+        return NULL;
+    }
+
+    if (offset >= deserializer->strings_size) {
+        deserializer->ok = false;
+        return NULL;
+    }
+
+    return (char *)deserializer->strings + offset;
+}
+
 // This file is part of Lute.
 // Copyright (C) 2024  Hjalte C. Nannestad
 //
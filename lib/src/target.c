@@ -18,22 +18,16 @@ void dep_free(Dep *dep) {
     free(dep->target);
 }
 
-void serialize_dep(const Dep *dep, FILE *file) {
-    serialize_str(dep->url, file);
-    serialize_str(dep->target, file);
+void serialize_dep(const Dep *dep, Serializer *serializer) {
+    serialize_str(serializer, dep->url);
+    serialize_str(serializer, dep->target);
 }
 
-bool deserialize_dep(Dep *dep, FILE *file) {
-    *dep = (Dep){0};
+bool deserialize_dep(Dep *dep, Deserializer *deserializer) {
+    dep->url = deserialize_str(deserializer);
+    dep->target = deserialize_str(deserializer);
 
-    bool success =
-        deserialize_str(&dep->url, file) && deserialize_str(&dep->target, file);
-
-    if (!success) {
-        dep_free(dep);
-    }
-
-    return success;
+    return deserializer->ok && dep->url && dep->target;
 }
 
 void deps_free(Deps *deps) {
@@ -41,28 +35,6 @@ void deps_free(Deps *deps) {
     vec_free(deps);
 }
 
-bool deserialize_deps(Deps *deps, FILE *file) {
-    *deps = (Deps){0};
-
-    size_t len;
-    if (!deserialize_data(&len, file)) {
-        return false;
-    }
-
-    for (size_t i = 0; i < len; i++) {
-        Dep dep;
-
-        if (!deserialize_dep(&dep, file)) {
-            deps_free(deps);
-            return false;
-        }
-
-        vec_push(deps, dep);
-    }
-
-    return true;
-}
-
 const char *standard_name(Standard std) {
     switch (std) {
     case C89:
@@ -133,6 +105,7 @@ bool target_init(Target *target, const char *name, Output kind) {
     target->std = 0;
 
     vec_init(&target->sources);
+    vec_init(&target->extensions);
     vec_init(&target->includes);
     vec_init(&target->packages);
     vec_init(&target->deps);
@@ -143,73 +116,150 @@ bool target_init(Target *target, const char *name, Output kind) {
 void target_free(Target *target) {
     free(target->name);
 
-    vec_foreach(&target->sources, source) free(source);
+    vec_foreachat(&target->sources, source) source_free(source);
+    vec_foreach(&target->extensions, extension) free(extension);
     vec_foreach(&target->includes, include) free(include);
     vec_foreach(&target->packages, package) free(package);
     vec_foreachat(&target->deps, dep) dep_free(dep);
 
     vec_free(&target->sources);
+    vec_free(&target->extensions);
     vec_free(&target->includes);
     vec_free(&target->packages);
     vec_free(&target->deps);
 }
 
-void serialize_target(const Target *target, FILE *file) {
-    serialize_str(target->name, file);
-    serialize_data(&target->output, file);
-    serialize_data(&target->warn, file);
-    serialize_data(&target->lang, file);
-    serialize_data(&target->std, file);
+static void serialize_strings(const Strings *strings,
+                              Serializer *serializer) {
+    serialize_u32(serializer, strings->len);
+    vec_foreach(strings, string) serialize_str(serializer, string);
+}
 
-    serialize_data(&target->sources.len, file);
-    vec_foreach(&target->sources, source) serialize_str(source, file);
+void serialize_target(const Target *target, Serializer *serializer) {
+    serialize_str(serializer, target->name);
+    serialize_u32(serializer, target->output);
+    serialize_u32(serializer, target->warn);
+    serialize_u32(serializer, target->lang);
+    serialize_u32(serializer, target->std);
 
-    serialize_data(&target->includes.len, file);
-    vec_foreach(&target->includes, include) serialize_str(include, file);
+    serialize_u32(serializer, target->sources.len);
+    vec_foreachat(&target->sources, source) serialize_source(source, serializer);
 
-    serialize_data(&target->packages.len, file);
-    vec_foreach(&target->packages, package) serialize_str(package, file);
+    serialize_strings(&target->extensions, serializer);
+    serialize_strings(&target->includes, serializer);
+    serialize_strings(&target->packages, serializer);
 
-    serialize_data(&target->deps.len, file);
-    vec_foreachat(&target->deps, dep) serialize_dep(dep, file);
+    serialize_u32(serializer, target->deps.len);
+    vec_foreachat(&target->deps, dep) serialize_dep(dep, serializer);
 }
 
-static bool deserialize_strings(Strings *strings, FILE *file) {
-    size_t len;
-    if (!deserialize_data(&len, file)) {
-        return false;
+// Allocate the data of a deserialized vector of `len` elements.
+//
+// Every element takes at least `fields` fields, so a length that does not fit
+// in the rest of the body is malformed rather than allocated.
+static void *deserialize_vec_data(Deserializer *deserializer, uint32_t len,
+                                  size_t fields, size_t size) {
+    if (!deserializer->ok ||
+        len > (deserializer->len - deserializer->pos) / fields) {
+        deserializer->ok = false;
+        return NULL;
     }
 
-    for (size_t i = 0; i < len; i++) {
-        char *string;
-        if (!deserialize_str(&string, file)) {
+    return len ? arena_alloc(deserializer->arena, size * len) : NULL;
+}
+
+static bool deserialize_strings(Strings *strings,
+                                Deserializer *deserializer) {
+    uint32_t len = deserialize_u32(deserializer);
+
+    strings->data = deserialize_vec_data(deserializer, len, 1, sizeof(char *));
+    strings->cap = deserializer->ok ? len : 0;
+
+    for (uint32_t i = 0; i < len && deserializer->ok; i++) {
+        char *string = deserialize_str(deserializer);
+
+        if (!string) {
             return false;
         }
 
-        vec_push(strings, string);
+        strings->data[strings->len++] = string;
     }
 
-    return true;
+    return deserializer->ok;
+}
+
+void source_free(Source *source) {
+    free(source->path);
+    free(source->pattern);
+
+    vec_foreach(&source->excludes, exclude) free(exclude);
+    vec_free(&source->excludes);
+}
+
+void serialize_source(const Source *source, Serializer *serializer) {
+    serialize_str(serializer, source->path);
+    serialize_str(serializer, source->pattern);
+    serialize_strings(&source->excludes, serializer);
+}
+
+bool deserialize_source(Source *source, Deserializer *deserializer) {
+    *source = (Source){0};
+
+    source->path = deserialize_str(deserializer);
+    source->pattern = deserialize_str(deserializer);
+
+    return source->path &&
+           deserialize_strings(&source->excludes, deserializer);
 }
 
-bool deserialize_target(Target *target, FILE *file) {
+static bool deserialize_sources(Sources *sources,
+                                Deserializer *deserializer) {
+    uint32_t len = deserialize_u32(deserializer);
+
+    // path, pattern and the count of excludes
+    sources->data = deserialize_vec_data(deserializer, len, 3, sizeof(Source));
+    sources->cap = deserializer->ok ? len : 0;
+
+    for (uint32_t i = 0; i < len && deserializer->ok; i++) {
+        if (!deserialize_source(&sources->data[i], deserializer)) {
+            return false;
+        }
+
+        sources->len++;
+    }
+
+    return deserializer->ok;
+}
+
+bool deserialize_target(Target *target, Deserializer *deserializer) {
     *target = (Target){0};
 
-    bool success = deserialize_str(&target->name, file) &&
-                   deserialize_data(&target->output, file) &&
-                   deserialize_data(&target->warn, file) &&
-                   deserialize_data(&target->lang, file) &&
-                   deserialize_data(&target->std, file) &&
-                   deserialize_strings(&target->sources, file) &&
-                   deserialize_strings(&target->includes, file) &&
-                   deserialize_strings(&target->packages, file) &&
-                   deserialize_deps(&target->deps, file);
-
-    if (!success) {
-        target_free(target);
+    target->name = deserialize_str(deserializer);
+    target->output = deserialize_u32(deserializer);
+    target->warn = deserialize_u32(deserializer);
+    target->lang = deserialize_u32(deserializer);
+    target->std = deserialize_u32(deserializer);
+
+    bool success = target->name &&
+                   deserialize_sources(&target->sources, deserializer) &&
+                   deserialize_strings(&target->extensions, deserializer) &&
+                   deserialize_strings(&target->includes, deserializer) &&
+                   deserialize_strings(&target->packages, deserializer);
+
+    uint32_t deps = success ? deserialize_u32(deserializer) : 0;
+
+    if (success) {
+        target->deps.data =
+            deserialize_vec_data(deserializer, deps, 2, sizeof(Dep));
+        target->deps.cap = deserializer->ok ? deps : 0;
     }
 
-    return success;
+    for (uint32_t i = 0; i < deps && deserializer->ok && success; i++) {
+        success = deserialize_dep(&target->deps.data[i], deserializer);
+        target->deps.len += success;
+    }
+
+    return success && deserializer->ok;
 }
 
 void targets_free(Targets *targets) {
@@ -217,30 +267,32 @@ void targets_free(Targets *targets) {
     vec_free(targets);
 }
 
-void serialize_targets(const Targets *targets, FILE *file) {
-    serialize_data(&targets->len, file);
-    vec_foreach(targets, target) serialize_target(target, file);
+void serialize_targets(const Targets *targets, Serializer *serializer) {
+    serialize_u32(serializer, targets->len);
+    vec_foreach(targets, target) serialize_target(target, serializer);
 }
 
-bool deserialize_targets(Targets *targets, FILE *file) {
+bool deserialize_targets(Targets *targets, Deserializer *deserializer) {
     *targets = (Targets){0};
 
-    size_t len;
-    if (!deserialize_data(&len, file)) {
-        return false;
-    }
+    uint32_t len = deserialize_u32(deserializer);
 
-    for (size_t i = 0; i < len; i++) {
-        Target *target = malloc(sizeof(Target));
-        if (!deserialize_target(target, file)) {
-            targets_free(targets);
+    // name, output, warn, lang, std and five counts
+    targets->data =
+        deserialize_vec_data(deserializer, len, 10, sizeof(Target *));
+    targets->cap = deserializer->ok ? len : 0;
+
+    for (uint32_t i = 0; i < len && deserializer->ok; i++) {
+        Target *target = arena_alloc(deserializer->arena, sizeof(Target));
+
+        if (!deserialize_target(target, deserializer)) {
             return false;
         }
 
-        vec_push(targets, target);
+        targets->data[targets->len++] = target;
     }
 
-    return true;
+    return deserializer->ok;
 }
 
 // This file is part of Lute.
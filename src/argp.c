@@ -19,10 +19,7 @@ BuildTarget *select_target(const BuildGraph *graph, int argc, char **argv,
     BuildTarget *target = NULL;
 
     if (argc > 2 && is_valid_target_name(argv[2])) {
-        vec_foreachat(&graph->root->targets, t) {
-            if (strcmp(t->name, argv[2]) == 0)
-                target = t;
-        }
+        target = build_node_target(graph->root, argv[2]);
 
         (*argi)++;
 
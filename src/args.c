@@ -1,24 +1,81 @@
 // Copyright (C) 2024  Hjalte C. Nannestad
 // See end of file for license information.
 
+#include <ctype.h>
+
 #include "args.h"
+#include "process.h"
 
 Args args_new() {
     Args args;
     vec_init(&args);
+    arena_init(&args.arena);
     return args;
 }
 
 void args_free(Args *args) {
-    vec_foreach(args, arg) free(arg);
     vec_free(args);
+    arena_free(&args->arena);
 }
 
 void args_push(Args *args, const char *arg) {
-    char *copy = strdup(arg);
+    char *copy = arena_strdup(&args->arena, arg);
     vec_push(args, copy);
 }
 
+void args_push_all(Args *args, const Args *other) {
+    size_t size = 0;
+    vec_foreach(other, arg) size += strlen(arg) + 1;
+
+    char *copy = arena_alloc(&args->arena, size);
+    vec_reserve(args, args->len + other->len);
+
+    vec_foreach(other, arg) {
+        size_t len = strlen(arg) + 1;
+        args->data[args->len++] = memcpy(copy, arg, len);
+        copy += len;
+    }
+}
+
+void args_push_split(Args *args, const char *str) {
+    char *word = malloc(strlen(str) + 1);
+
+    while (*str) {
+        while (isspace((unsigned char)*str))
+            str++;
+
+        if (!*str)
+            break;
+
+        size_t len = 0;
+        char quote = '\0';
+
+        for (; *str; str++) {
+            if (quote) {
+                if (*str == quote)
+                    quote = '\0';
+                else if (*str == '\\' && quote == '"' && str[1])
+                    word[len++] = *++str;
+                else
+                    word[len++] = *str;
+            } else if (*str == '\'' || *str == '"') {
+                quote = *str;
+            } else if (*str == '\\' && str[1]) {
+                word[len++] = *++str;
+            } else if (isspace((unsigned char)*str)) {
+                break;
+            } else {
+                word[len++] = *str;
+            }
+        }
+
+        word[len] = '\0';
+        args_push(args, word);
+    }
+
+    free(word);
+}
+
 char *args_join(Args *args) { return vec_join((Vec(const char *) *)args, " "); }
 
 void args_print(FILE *file, Args *args) {
@@ -26,11 +83,24 @@ void args_print(FILE *file, Args *args) {
     fprintf(file, "\n");
 }
 
+Hash args_hash(const Args *args) {
+    HashState state;
+    hash_init(&state);
+
+    // include the terminator so argument boundaries are part of the hash
+    vec_foreach(args, arg) hash_update(&state, arg, strlen(arg) + 1);
+
+    return hash_final(&state);
+}
+
 int args_exec(Args *args) {
-    char *cmd = args_join(args);
-    int ret = system(cmd);
-    free(cmd);
-    return ret;
+    Process process;
+
+    if (!process_spawn(&process, args, PROCESS_INHERIT, NULL)) {
+        return -1;
+    }
+
+    return process_wait(&process);
 }
 
 // This file is part of Lute.
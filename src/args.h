@@ -5,16 +5,46 @@
 
 #include <stdio.h>
 
+#include <lute/arena.h>
 #include <lute/vector.h>
 
-typedef Vec(char *) Args;
+#include "hash.h"
+
+// The arguments of a command.
+//
+// Laid out like a `Vec(char *)`, so the vector macros work on it. The
+// arguments are copied into the arena, so they are freed at once.
+typedef struct {
+    char **data;
+    size_t len;
+    size_t cap;
+
+    Arena arena;
+} Args;
 
 Args args_new();
 void args_free(Args *args);
 
 void args_push(Args *args, const char *arg);
+
+// Push every argument of another command, copying them in a single allocation.
+void args_push_all(Args *args, const Args *other);
+
+// Split a string into words and push each of them.
+//
+// Words are separated by whitespace, and can be quoted with single or double
+// quotes or escaped with a backslash, like the output of pkg-config.
+void args_push_split(Args *args, const char *str);
+
 char *args_join(Args *args);
 void args_print(FILE *file, Args *args);
+
+// Hash every argument of a command, used to detect changed commands.
+Hash args_hash(const Args *args);
+
+// Run the command and wait for it to finish.
+//
+// Returns the exit code of the command, or -1 if it could not be run.
 int args_exec(Args *args);
 
 // This file is part of Lute.
@@ -7,8 +7,12 @@
 #include "argp.h"
 #include "args.h"
 #include "build.h"
+#include "depfile.h"
 #include "fs.h"
+#include "jobs.h"
 #include "log.h"
+#include "objcache.h"
+#include "task.h"
 
 static const char *get_compiler(const BuildTarget *target) {
     char *cc = getenv("CC");
@@ -30,8 +34,12 @@ static const char *get_compiler(const BuildTarget *target) {
 void print_build_options() {
     INFO("  -h, --help                Show this help message\n"
          "  -v, --verbose             Show verbose output\n"
+         "  -j, --jobs <n>            Run n jobs in parallel\n"
          "  -r, --release             Build with release profile\n"
-         "  -d, --debug (default)     Build with debug profile\n");
+         "  -d, --debug (default)     Build with debug profile\n"
+         "      --content-hash        "
+         "Rebuild only when the content of sources changes\n"
+         "      --no-cache            Do not use the object cache\n");
 }
 
 void print_build_usage() {
@@ -61,6 +69,9 @@ BuildOptions build_options_default() {
     options.help = false;
     options.verbose = false;
     options.profile = PROFILE_DEBUG;
+    options.jobs = default_jobs();
+    options.content_hash = false;
+    options.cache = true;
     return options;
 }
 
@@ -74,10 +85,21 @@ bool build_options_parse(BuildOptions *options, int argc, char **argv,
             options->help = true;
         } else if (arg_is(arg, "-v", "--verbose")) {
             options->verbose = true;
+        } else if (arg_is(arg, "-j", "--jobs")) {
+            char *jobs = *argi < argc ? argv[(*argi)++] : NULL;
+
+            if (!parse_jobs(jobs, &options->jobs)) {
+                ERROR("Invalid job count: %s\n", jobs ? jobs : "");
+                return false;
+            }
         } else if (arg_is(arg, "-r", "--release")) {
             options->profile = PROFILE_RELEASE;
         } else if (arg_is(arg, "-d", "--debug")) {
             options->profile = PROFILE_DEBUG;
+        } else if (arg_is(arg, NULL, "--content-hash")) {
+            options->content_hash = true;
+        } else if (arg_is(arg, NULL, "--no-cache")) {
+            options->cache = false;
         } else if (arg_is(arg, "--", NULL)) {
             break;
         } else {
@@ -127,238 +149,456 @@ int build_command(int argc, char **argv, int *argi) {
     return 0;
 }
 
-bool build_target(const BuildOptions *options, const BuildTarget *target,
-                  Output output, const char *outdir) {
-    INFO("Building target %s", target->name);
+// Get the path of the .d file the compiler writes next to an object.
+static void depfile_path(char *path, size_t size, const char *object) {
+    size_t len = strlen(object);
+
+    if (len > 2 && strcmp(object + len - 2, ".o") == 0)
+        len -= 2;
+
+    snprintf(path, size, "%.*s.d", (int)len, object);
+}
+
+// A target that has been added to a build plan.
+typedef struct {
+    const BuildTarget *target;
+    char *outdir;
+
+    // The task that finishes when all outputs of the target are built.
+    Task *done;
+
+    // Whether any output of the target is rebuilt.
+    bool changed;
+} PlannedTarget;
+
+// The tasks needed to build a target and all of its dependencies.
+typedef struct {
+    const BuildOptions *options;
+    TaskGraph tasks;
+    Vec(PlannedTarget) planned;
+    DepsLog deps;
+
+    // Whether the object cache is open and used.
+    bool caching;
+    ObjectCache cache;
+} BuildPlan;
+
+static bool build_plan_init(BuildPlan *plan, const BuildOptions *options) {
+    plan->options = options;
+    task_graph_init(&plan->tasks);
+    plan->tasks.context = plan;
+    plan->caching = false;
+    vec_init(&plan->planned);
+
+    if (!deps_log_open(&plan->deps, "lute-cache/deps.log")) {
+        return false;
+    }
+
+    // the build works without the cache, it is just slower
+    plan->caching = options->cache && object_cache_open(&plan->cache);
+
+    if (options->cache && !plan->caching) {
+        object_cache_close(&plan->cache);
+    }
 
+    return true;
+}
+
+static void build_plan_free(BuildPlan *plan) {
+    if (plan->caching) {
+        object_cache_close(&plan->cache);
+    }
+
+    deps_log_close(&plan->deps);
+    task_graph_free(&plan->tasks);
+    vec_foreachat(&plan->planned, planned) free(planned->outdir);
+    vec_free(&plan->planned);
+}
+
+static void dep_outdir(char *outdir, size_t size, const BuildOptions *options,
+                       const BuildDep *dep) {
+    snprintf(outdir, size, "lute-cache/deps/out/%s/%s",
+             profile_name(options->profile), dep->id);
+}
+
+static void push_profile_flags(Args *args, const BuildOptions *options) {
     switch (options->profile) {
     case PROFILE_DEBUG:
-        INFO("[debug]\n");
+        args_push(args, "-g");
+        args_push(args, "-O1");
         break;
     case PROFILE_RELEASE:
-        INFO("[release]\n");
+        args_push(args, "-O3");
         break;
     }
+}
 
-    vec_foreach(&target->deps, dep) {
-        char depoutdir[256];
-        snprintf(depoutdir, sizeof(depoutdir), "lute-cache/deps/out/%s/%s",
-                 profile_name(options->profile), dep->id);
+static void push_std_flag(Args *args, const BuildTarget *target) {
+    if (target->std) {
+        char std[256];
+        snprintf(std, sizeof(std), "-std=%s", standard_name(target->std));
+        args_push(args, std);
+    }
+}
 
-        if (!build_target(options, dep->node->targets.data, STATIC | BINARY,
-                          depoutdir))
-            return false;
+static void push_includes(Args *args, const BuildTarget *target) {
+    vec_foreach(&target->includes, include) {
+        args_push(args, "-I");
+        args_push(args, include);
     }
 
-    if (!build_objects(options, target, outdir))
-        return false;
+    vec_foreach(&target->deps, dep) push_includes(args, dep->target);
+}
 
-    const char *compiler = get_compiler(target);
+static bool finish_compile(Task *task, void *context) {
+    BuildPlan *plan = context;
 
-    if (!compiler) {
-        ERROR("Error: No compiler found\n");
+    if (!build_record_deps(&plan->deps, task->output, args_hash(&task->args),
+                           plan->options->content_hash)) {
         return false;
     }
 
-    Vec(const char *) objects;
-    vec_init(&objects);
+    // the only input of a compile is its source
+    Hash key;
 
-    vec_foreach(&target->sources, source) {
-        HashId id;
-        hash_string(id, "obj", source);
+    if (plan->caching &&
+        object_cache_key(&plan->cache, &task->args, task->inputs.data[0],
+                         &key) &&
+        !object_cache_store(&plan->cache, key, task->output, &plan->deps)) {
+        ERROR("Warning: Could not store %s in the object cache\n",
+              task->output);
+    }
+
+    return true;
+}
+
+static bool finish_link(Task *task, void *context) {
+    BuildPlan *plan = context;
+
+    DepsRecord record;
+    deps_record_init(&record);
+    record.command = args_hash(&task->args);
 
-        char *object = malloc(256);
-        snprintf(object, 256, "%s/%s.o", outdir, id);
+    vec_foreach(&task->inputs, input) {
+        FileStat st;
 
-        vec_push(&objects, object);
+        // libraries of dependencies are only inputs if they are built
+        if (!file_stat(input, &st))
+            continue;
+
+        DepsEntry entry = {
+            .path = input,
+            .mtime = st.mtime,
+            .size = st.size,
+            .hash = {0},
+        };
+
+        vec_push(&record.deps, entry);
     }
 
-    char *objs = vec_join(&objects, " ");
-    vec_free(&objects);
+    bool success = deps_log_record(&plan->deps, task->output, &record);
+    deps_record_free(&record);
 
-    if (target->output & output & BINARY) {
-        INFO("Building binary %s\n", target->name);
-
-        char binpath[256];
-        snprintf(binpath, sizeof(binpath), "%s/%s", outdir, target->name);
-
-        Args args = args_new();
-        args_push(&args, compiler);
-        args_push(&args, objs);
-        args_push(&args, "-o");
-        args_push(&args, binpath);
-        args_push(&args, "-g");
-
-        switch (options->profile) {
-        case PROFILE_DEBUG:
-            args_push(&args, "-g");
-            args_push(&args, "-O1");
-            break;
-        case PROFILE_RELEASE:
-            args_push(&args, "-O3");
-            break;
-        }
+    return success;
+}
 
-        if (target->std) {
-            char std[256];
-            snprintf(std, sizeof(std), "-std=%s", standard_name(target->std));
-            args_push(&args, std);
-        }
+// Add a task linking an output to a plan.
+//
+// The inputs are the objects and libraries the output is linked from. If
+// `changed` is false, none of the inputs are rebuilt by the plan, and the task
+// is only added if the output is dirty. Returns NULL if the output is up to
+// date.
+static Task *plan_link(BuildPlan *plan, Args args, Args inputs,
+                       const char *output, const char *message,
+                       const char *error, bool changed) {
+    if (!changed &&
+        !build_output_dirty(&plan->deps, output, args_hash(&args), false)) {
+        args_free(&args);
+        args_free(&inputs);
+        return NULL;
+    }
 
-        vec_foreach(&target->packages, package) {
-            args_push(&args, package->libs);
-        }
+    Task *task = task_graph_add(&plan->tasks, args, message, error);
+    task->output = strdup(output);
+    task->inputs = inputs;
+    task->finish = finish_link;
 
-        vec_foreach(&target->deps, dep) {
-            if (!(dep->target->output & LIBRARY))
-                continue;
+    return task;
+}
 
-            char depoutdir[256];
-            snprintf(depoutdir, sizeof(depoutdir), "lute-cache/deps/out/%s/%s",
-                     profile_name(options->profile), dep->id);
+// Push the libraries of the dependencies of a target with any of the outputs.
+static void push_dep_libs(Args *inputs, const BuildPlan *plan,
+                          const BuildTarget *target, Output output) {
+    vec_foreach(&target->deps, dep) {
+        char depoutdir[256];
+        dep_outdir(depoutdir, sizeof(depoutdir), plan->options, dep);
 
-            args_push(&args, "-L");
-            args_push(&args, depoutdir);
-            args_push(&args, "-l");
-            args_push(&args, dep->name);
+        char deplib[512];
+
+        if (dep->target->output & output & STATIC) {
+            snprintf(deplib, sizeof(deplib), "%s/lib%s.a", depoutdir,
+                     dep->name);
+            args_push(inputs, deplib);
         }
 
-        if (options->verbose) {
-            INFO("Executing: ");
-            args_print(stderr, &args);
+        if (dep->target->output & output & SHARED) {
+            snprintf(deplib, sizeof(deplib), "%s/lib%s.so", depoutdir,
+                     dep->name);
+            args_push(inputs, deplib);
         }
+    }
+}
 
-        bool success = args_exec(&args) == 0;
-        args_free(&args);
+// Add a task compiling a source to a plan.
+//
+// Objects found in the object cache are restored right away instead. Returns
+// NULL if the object is up to date or restored, `changed` is set unless it was
+// up to date.
+static Task *plan_compile(BuildPlan *plan, const BuildTarget *target,
+                          const char *compiler, const char *source,
+                          const char *object, bool *changed) {
+    Args args = args_new();
+    args_push(&args, compiler);
+    args_push(&args, "-c");
+    args_push(&args, source);
+    args_push(&args, "-o");
+    args_push(&args, object);
+    args_push(&args, "-MD");
+
+    push_profile_flags(&args, plan->options);
+    push_std_flag(&args, target);
+    push_includes(&args, target);
+
+    vec_foreach(&target->packages, package) {
+        args_push_split(&args, package->cflags);
+    }
 
-        if (!success) {
-            ERROR("Error: Could not build binary %s\n", target->name);
-            return false;
-        }
+    if (target->warn & Wall)
+        args_push(&args, "-Wall");
+    if (target->warn & Wextra)
+        args_push(&args, "-Wextra");
+    if (target->warn & Werror)
+        args_push(&args, "-Werror");
+
+    Hash command = args_hash(&args);
+
+    if (!build_output_dirty(&plan->deps, object, command,
+                            plan->options->content_hash)) {
+        args_free(&args);
+        return NULL;
     }
 
-    if (target->output & output & STATIC) {
-        INFO("Building static library %s\n", target->name);
+    *changed = true;
 
-        char libpath[256];
-        snprintf(libpath, sizeof(libpath), "%s/lib%s.a", outdir, target->name);
+    Hash key;
 
-        Args args = args_new();
+    if (plan->caching && object_cache_key(&plan->cache, &args, source, &key) &&
+        object_cache_restore(&plan->cache, key, object, &plan->deps,
+                             command)) {
+        INFO("Restored %s from cache\n", source);
+        args_free(&args);
+        return NULL;
+    }
 
-        args_push(&args, getenv("AR") ? getenv("AR") : "ar");
-        args_push(&args, "rcs");
-        args_push(&args, libpath);
-        args_push(&args, objs);
+    char message[512];
+    snprintf(message, sizeof(message), "Compiling %s", source);
 
-        vec_foreach(&target->packages, package) {
-            args_push(&args, package->links);
-        }
+    char error[512];
+    snprintf(error, sizeof(error), "Could not compile %s", source);
 
-        vec_foreach(&target->deps, dep) {
-            if (!(dep->target->output & STATIC))
-                continue;
+    Task *task = task_graph_add(&plan->tasks, args, message, error);
+    task->output = strdup(object);
+    args_push(&task->inputs, source);
+    task->finish = finish_compile;
 
-            char deplib[256];
-            snprintf(deplib, sizeof(deplib), "lute-cache/deps/out/%s/lib%s.a",
-                     dep->id, dep->name);
+    return task;
+}
 
-            args_push(&args, deplib);
-        }
+static Task *plan_binary(BuildPlan *plan, const BuildTarget *target,
+                         const char *compiler, const Args *objects,
+                         const char *outdir, bool changed) {
+    char binpath[256];
+    snprintf(binpath, sizeof(binpath), "%s/%s", outdir, target->name);
 
-        if (options->verbose) {
-            INFO("Executing: ");
-            args_print(stderr, &args);
-        }
+    Args args = args_new();
+    args_push(&args, compiler);
+    args_push_all(&args, objects);
+    args_push(&args, "-o");
+    args_push(&args, binpath);
+    args_push(&args, "-g");
 
-        bool success = args_exec(&args) == 0;
-        args_free(&args);
+    push_profile_flags(&args, plan->options);
+    push_std_flag(&args, target);
 
-        if (!success) {
-            ERROR("Error: Could not build static library %s\n", target->name);
-            return false;
-        }
+    vec_foreach(&target->packages, package) {
+        args_push_split(&args, package->libs);
     }
 
-    if (target->output & output & SHARED) {
-        INFO("Building shared library %s\n", target->name);
+    vec_foreach(&target->deps, dep) {
+        if (!(dep->target->output & LIBRARY))
+            continue;
+
+        char depoutdir[256];
+        dep_outdir(depoutdir, sizeof(depoutdir), plan->options, dep);
 
-        char libpath[256];
-        snprintf(libpath, sizeof(libpath), "%s/lib%s.so", outdir, target->name);
+        args_push(&args, "-L");
+        args_push(&args, depoutdir);
+        args_push(&args, "-l");
+        args_push(&args, dep->name);
+    }
 
-        Args args = args_new();
+    char message[512];
+    snprintf(message, sizeof(message), "Building binary %s", target->name);
 
-        args_push(&args, compiler);
-        args_push(&args, "-shared");
-        args_push(&args, objs);
-        args_push(&args, "-o");
-        args_push(&args, libpath);
+    char error[512];
+    snprintf(error, sizeof(error), "Could not build binary %s", target->name);
 
-        switch (options->profile) {
-        case PROFILE_DEBUG:
-            args_push(&args, "-g");
-            args_push(&args, "-O1");
-            break;
-        case PROFILE_RELEASE:
-            args_push(&args, "-O3");
-            break;
-        }
+    Args inputs = args_new();
+    args_push_all(&inputs, objects);
+    push_dep_libs(&inputs, plan, target, LIBRARY);
 
-        if (target->std) {
-            char std[256];
-            snprintf(std, sizeof(std), "-std=%s", standard_name(target->std));
-            args_push(&args, std);
-        }
+    return plan_link(plan, args, inputs, binpath, message, error, changed);
+}
 
-        vec_foreach(&target->packages, package) {
-            args_push(&args, package->libs);
-        }
+static Task *plan_static(BuildPlan *plan, const BuildTarget *target,
+                         const Args *objects, const char *outdir,
+                         bool changed) {
+    char libpath[256];
+    snprintf(libpath, sizeof(libpath), "%s/lib%s.a", outdir, target->name);
 
-        vec_foreach(&target->deps, dep) {
-            if (!(dep->target->output & SHARED))
-                continue;
+    Args args = args_new();
+    args_push(&args, getenv("AR") ? getenv("AR") : "ar");
+    args_push(&args, "rcs");
+    args_push(&args, libpath);
+    args_push_all(&args, objects);
 
-            char depoutdir[256];
-            snprintf(depoutdir, sizeof(depoutdir), "lute-cache/deps/out/%s",
-                     dep->id);
+    vec_foreach(&target->packages, package) {
+        args_push_split(&args, package->links);
+    }
 
-            args_push(&args, "-L");
-            args_push(&args, depoutdir);
-            args_push(&args, "-l");
-            args_push(&args, dep->name);
-        }
+    vec_foreach(&target->deps, dep) {
+        if (!(dep->target->output & STATIC))
+            continue;
 
-        if (options->verbose) {
-            INFO("Executing: ");
-            args_print(stderr, &args);
-        }
+        char depoutdir[256];
+        dep_outdir(depoutdir, sizeof(depoutdir), plan->options, dep);
 
-        bool success = args_exec(&args) == 0;
-        args_free(&args);
+        char deplib[512];
+        snprintf(deplib, sizeof(deplib), "%s/lib%s.a", depoutdir, dep->name);
 
-        if (!success) {
-            ERROR("Error: Could not build shared library %s\n", target->name);
-            return false;
-        }
+        args_push(&args, deplib);
     }
 
-    return true;
+    char message[512];
+    snprintf(message, sizeof(message), "Building static library %s",
+             target->name);
+
+    char error[512];
+    snprintf(error, sizeof(error), "Could not build static library %s",
+             target->name);
+
+    Args inputs = args_new();
+    args_push_all(&inputs, objects);
+    push_dep_libs(&inputs, plan, target, STATIC);
+
+    return plan_link(plan, args, inputs, libpath, message, error, changed);
 }
 
-static void push_includes(Args *args, const BuildTarget *target) {
-    vec_foreach(&target->includes, include) {
-        args_push(args, "-I");
-        args_push(args, include);
+static Task *plan_shared(BuildPlan *plan, const BuildTarget *target,
+                         const char *compiler, const Args *objects,
+                         const char *outdir, bool changed) {
+    char libpath[256];
+    snprintf(libpath, sizeof(libpath), "%s/lib%s.so", outdir, target->name);
+
+    Args args = args_new();
+    args_push(&args, compiler);
+    args_push(&args, "-shared");
+    args_push_all(&args, objects);
+    args_push(&args, "-o");
+    args_push(&args, libpath);
+
+    push_profile_flags(&args, plan->options);
+    push_std_flag(&args, target);
+
+    vec_foreach(&target->packages, package) {
+        args_push_split(&args, package->libs);
     }
 
-    vec_foreach(&target->deps, dep) push_includes(args, dep->target);
+    vec_foreach(&target->deps, dep) {
+        if (!(dep->target->output & SHARED))
+            continue;
+
+        char depoutdir[256];
+        dep_outdir(depoutdir, sizeof(depoutdir), plan->options, dep);
+
+        args_push(&args, "-L");
+        args_push(&args, depoutdir);
+        args_push(&args, "-l");
+        args_push(&args, dep->name);
+    }
+
+    char message[512];
+    snprintf(message, sizeof(message), "Building shared library %s",
+             target->name);
+
+    char error[512];
+    snprintf(error, sizeof(error), "Could not build shared library %s",
+             target->name);
+
+    Args inputs = args_new();
+    args_push_all(&inputs, objects);
+    push_dep_libs(&inputs, plan, target, SHARED);
+
+    return plan_link(plan, args, inputs, libpath, message, error, changed);
 }
 
-bool build_objects(const BuildOptions *options, const BuildTarget *target,
-                   const char *outdir) {
+// Add the tasks for building a target and its dependencies to a plan.
+//
+// Only the tasks for outputs that are out of date are added, `changed` is set
+// if there are any. Returns the task that finishes when every output of the
+// target is built, or NULL if the target cannot be planned.
+static Task *plan_target(BuildPlan *plan, const BuildTarget *target,
+                         Output output, const char *outdir, bool *changed) {
+    // targets shared between dependencies are only built once
+    vec_foreachat(&plan->planned, planned) {
+        if (planned->target == target &&
+            strcmp(planned->outdir, outdir) == 0) {
+            *changed = planned->changed;
+            return planned->done;
+        }
+    }
+
+    INFO("Building target %s[%s]\n", target->name,
+         profile_name(plan->options->profile));
+
+    Tasks deps;
+    vec_init(&deps);
+
+    // whether any library linked into the target is rebuilt
+    bool deps_changed = false;
+
+    vec_foreach(&target->deps, dep) {
+        char depoutdir[256];
+        dep_outdir(depoutdir, sizeof(depoutdir), plan->options, dep);
+
+        bool dep_changed = false;
+        Task *done = plan_target(plan, dep->target, STATIC | BINARY, depoutdir,
+                                 &dep_changed);
+
+        deps_changed |= dep_changed;
+
+        if (!done) {
+            vec_free(&deps);
+            return NULL;
+        }
+
+        vec_push(&deps, done);
+    }
+
     if (!make_dirs(outdir)) {
         ERROR("Error: Could not create output directory\n");
-
-        return false;
+        vec_free(&deps);
+        return NULL;
     }
 
     // get the compiler for the target, default to clang
@@ -366,9 +606,20 @@ bool build_objects(const BuildOptions *options, const BuildTarget *target,
 
     if (!compiler) {
         ERROR("Error: No compiler found\n");
-        return false;
+        vec_free(&deps);
+        return NULL;
     }
 
+    Args objects = args_new();
+    Tasks compiles;
+    vec_init(&compiles);
+
+    vec_reserve(&objects, target->sources.len);
+    vec_reserve(&compiles, target->sources.len);
+
+    // whether any object is compiled or restored from the cache
+    bool objects_changed = false;
+
     vec_foreach(&target->sources, source) {
         HashId id;
         hash_string(id, "obj", source);
@@ -376,147 +627,249 @@ bool build_objects(const BuildOptions *options, const BuildTarget *target,
         char object[256];
         snprintf(object, sizeof(object), "%s/%s.o", outdir, id);
 
-        if (!build_should_compile_object(object))
-            continue;
+        args_push(&objects, object);
 
-        INFO("Compiling %s\n", source);
+        Task *compile = plan_compile(plan, target, compiler, source, object,
+                                     &objects_changed);
 
-        Args args = args_new();
-        args_push(&args, compiler);
-        args_push(&args, "-c");
-        args_push(&args, source);
-        args_push(&args, "-o");
-        args_push(&args, object);
-        args_push(&args, "-MD");
+        if (compile)
+            vec_push(&compiles, compile);
+    }
 
-        switch (options->profile) {
-        case PROFILE_DEBUG:
-            args_push(&args, "-g");
-            args_push(&args, "-O1");
-            break;
-        case PROFILE_RELEASE:
-            args_push(&args, "-O3");
-            break;
-        }
+    char error[512];
+    snprintf(error, sizeof(error), "Could not build target %s", target->name);
 
-        if (target->std) {
-            char std[256];
-            snprintf(std, sizeof(std), "-std=%s", standard_name(target->std));
-            args_push(&args, std);
-        }
+    Task *done = task_graph_add(&plan->tasks, args_new(), NULL, error);
 
-        push_includes(&args, target);
+    Tasks links;
+    vec_init(&links);
 
-        vec_foreach(&target->packages, package) {
-            args_push(&args, package->cflags);
-        }
+    bool inputs_changed = objects_changed || deps_changed;
 
-        if (target->warn & Wall)
-            args_push(&args, "-Wall");
-        if (target->warn & Wextra)
-            args_push(&args, "-Wextra");
-        if (target->warn & Werror)
-            args_push(&args, "-Werror");
+    if (target->output & output & BINARY) {
+        Task *link = plan_binary(plan, target, compiler, &objects, outdir,
+                                 inputs_changed);
 
-        if (options->verbose) {
-            INFO("Executing: ");
-            args_print(stderr, &args);
-        }
+        if (link)
+            vec_push(&links, link);
+    }
 
-        bool success = args_exec(&args) == 0;
-        args_free(&args);
+    if (target->output & output & STATIC) {
+        Task *link = plan_static(plan, target, &objects, outdir,
+                                 inputs_changed);
 
-        if (!success) {
-            ERROR("Error: Could not compile %s\n", source);
-            return false;
-        }
+        if (link)
+            vec_push(&links, link);
     }
 
-    return true;
+    if (target->output & output & SHARED) {
+        Task *link = plan_shared(plan, target, compiler, &objects, outdir,
+                                 inputs_changed);
+
+        if (link)
+            vec_push(&links, link);
+    }
+
+    // the outputs of a target are linked independently of each other
+    vec_foreach(&links, link) {
+        vec_foreach(&compiles, compile) task_depend(link, compile);
+        vec_foreach(&deps, dep) task_depend(link, dep);
+        task_depend(done, link);
+    }
+
+    vec_foreach(&compiles, compile) task_depend(done, compile);
+    vec_foreach(&deps, dep) task_depend(done, dep);
+
+    *changed = objects_changed || links.len > 0;
+
+    PlannedTarget planned = {
+        .target = target,
+        .outdir = strdup(outdir),
+        .done = done,
+        .changed = *changed,
+    };
+
+    vec_push(&plan->planned, planned);
+
+    args_free(&objects);
+    vec_free(&compiles);
+    vec_free(&links);
+    vec_free(&deps);
+
+    return done;
 }
 
-bool build_should_compile_object(const char *object) {
-    if (!file_exists(object))
-        return true;
+bool build_target(const BuildOptions *options, const BuildTarget *target,
+                  Output output, const char *outdir) {
+    BuildPlan plan;
 
-    time_t modified;
+    if (!build_plan_init(&plan, options)) {
+        build_plan_free(&plan);
+        return false;
+    }
 
-    if (!last_modified(object, &modified))
-        return true;
+    bool changed = false;
+    bool success =
+        plan_target(&plan, target, output, outdir, &changed) &&
+        task_graph_run(&plan.tasks, options->jobs, options->verbose);
 
-    char *depfile = strdup(object);
-    depfile[strlen(depfile) - 1] = 'd';
+    build_plan_free(&plan);
 
-    FILE *file = fopen(depfile, "r");
+    return success;
+}
 
-    if (!file) {
-        free(depfile);
-        return true;
+// Read the dependencies of an object from its .d file.
+static bool read_object_deps(const char *depfile, const char *object,
+                             Strings *deps) {
+    char *target;
+
+    if (!depfile_parse(depfile, &target, deps)) {
+        ERROR("Error: Dependency file is malformed\n");
+        return false;
     }
 
-    char line[256];
+    bool matches = strcmp(object, target) == 0;
+    free(target);
+
+    if (!matches) {
+        ERROR("Error: Dependency file does not match object file\n");
 
-    if (!fgets(line, sizeof(line), file)) {
-        ERROR("Error: Dependency file is empty\n");
+        vec_foreach(deps, dep) free(dep);
+        vec_free(deps);
 
-        fclose(file);
-        free(depfile);
-        return true;
+        return false;
     }
 
-    char *start = strrchr(line, ':');
+    return true;
+}
+
+bool build_record_deps(DepsLog *log, const char *object, Hash command,
+                       bool content_hash) {
+    char depfile[512];
+    depfile_path(depfile, sizeof(depfile), object);
 
-    if (!start) {
-        ERROR("Error: Dependency file is malformed\n");
+    Strings deps;
+    vec_init(&deps);
 
-        fclose(file);
-        free(depfile);
-        return true;
+    if (!read_object_deps(depfile, object, &deps)) {
+        return false;
     }
 
-    *start = '\0';
+    // the .d file is only needed until it is in the log
+    remove(depfile);
 
-    if (strcmp(object, line) != 0) {
-        ERROR("Error: Dependency file does not match object file\n");
+    DepsRecord record;
+    deps_record_init(&record);
+    record.command = command;
+    record.hashed = content_hash;
 
-        fclose(file);
-        free(depfile);
-        return true;
+    bool success = true;
+
+    vec_foreach(&deps, dep) {
+        FileStat st;
+        DepsEntry entry = {.path = dep, .hash = {0}};
+
+        if (!file_stat(dep, &st) ||
+            (content_hash && !file_hash(dep, &entry.hash))) {
+            ERROR("Error: Could not fingerprint dependency %s\n", dep);
+            success = false;
+            break;
+        }
+
+        entry.mtime = st.mtime;
+        entry.size = st.size;
+
+        vec_push(&record.deps, entry);
     }
 
-    while (fgets(line, sizeof(line), file)) {
-        char *dep = line;
+    success = success && deps_log_record(log, object, &record);
 
-        while (*dep == ' ')
-            dep++;
+    deps_record_free(&record);
+    vec_foreach(&deps, dep) free(dep);
+    vec_free(&deps);
 
-        char *end = strchr(dep, ' ');
-        if (end)
-            *end = '\0';
+    return success;
+}
 
-        char *newline = strchr(dep, '\n');
-        if (newline)
-            *newline = '\0';
+// Compare the recorded fingerprints of an object with its dependencies.
+//
+// Fingerprints whose time changed but content did not are refreshed, so the
+// content is not hashed again on the next build. Returns true if any
+// dependency has changed.
+static bool fingerprints_changed(DepsLog *log, const char *object,
+                                 DepsRecord *record) {
+    bool refreshed = false;
 
-        time_t dep_modified;
+    vec_foreachat(&record->deps, dep) {
+        FileStat st;
 
-        if (!last_modified(dep, &dep_modified)) {
-            ERROR("Error: Could not get last modified time of dependency %s\n",
-                  dep);
+        if (!file_stat(dep->path, &st) || st.size != dep->size)
+            return true;
+
+        // an unchanged time and size is trusted without reading the file
+        if (st.mtime == dep->mtime)
+            continue;
+
+        Hash current;
 
-            fclose(file);
-            free(depfile);
+        if (!file_hash(dep->path, &current) || !hash_equal(current, dep->hash))
             return true;
+
+        dep->mtime = st.mtime;
+        refreshed = true;
+    }
+
+    if (refreshed) {
+        deps_log_record(log, object, record);
+    }
+
+    return false;
+}
+
+bool build_output_dirty(DepsLog *log, const char *output, Hash command,
+                        bool content_hash) {
+    FileStat output_stat;
+
+    if (!file_stat(output, &output_stat))
+        return true;
+
+    DepsRecord record;
+    deps_record_init(&record);
+
+    // a missing record or a changed command always means a rebuild
+    if (!deps_log_get(log, output, &record) || !hash_equal(record.command, command)) {
+        deps_record_free(&record);
+        return true;
+    }
+
+    bool dirty = false;
+
+    if (content_hash && record.hashed) {
+        dirty = fingerprints_changed(log, output, &record);
+        deps_record_free(&record);
+        return dirty;
+    }
+
+    vec_foreachat(&record.deps, dep) {
+        FileStat dep_stat;
+
+        if (!file_stat(dep->path, &dep_stat)) {
+            ERROR("Error: Could not get last modified time of dependency %s\n",
+                  dep->path);
+
+            dirty = true;
+            break;
         }
 
-        if (dep_modified > modified) {
-            fclose(file);
-            free(depfile);
-            return true;
+        if (dep_stat.mtime > output_stat.mtime) {
+            dirty = true;
+            break;
         }
     }
 
-    return false;
+    deps_record_free(&record);
+
+    return dirty;
 }
 
 // This file is part of Lute.
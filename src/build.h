@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include "depslog.h"
 #include "graph.h"
 
 typedef enum {
@@ -14,6 +15,14 @@ typedef struct {
     bool help;
     bool verbose;
     Profile profile;
+    size_t jobs;
+
+    // Decide whether objects are out of date by comparing the content of
+    // their sources and headers, rather than only their last-modified time.
+    bool content_hash;
+
+    // Restore objects from the object cache instead of compiling them.
+    bool cache;
 } BuildOptions;
 
 const char *profile_name(Profile profile);
@@ -28,16 +37,34 @@ void print_build_options();
 void print_build_usage();
 void print_build_help();
 
+// Build the given outputs of a target and all of its dependencies.
+//
+// Compile, archive and link steps of the whole dependency graph are scheduled
+// as one task graph, running up to `options->jobs` commands at once.
 bool build_target(const BuildOptions *options, const BuildTarget *target,
                   Output output, const char *outdir);
-bool build_objects(const BuildOptions *options, const BuildTarget *target,
-                   const char *output);
 
-// Compare the last-modified time of the object file with the last-modified
-// of the dependencies found in the .d file.
+// Check if an output is out of date.
+//
+// The output is out of date if the hash of the command that would build it
+// differs from the recorded one. Otherwise the last-modified time of the output
+// is compared with the last-modified time of the dependencies recorded in the
+// deps log. With `content_hash` the recorded fingerprints are compared instead,
+// see `build_record_deps`.
+//
+// Returns true if the output needs to be built.
+bool build_output_dirty(DepsLog *log, const char *output, Hash command,
+                        bool content_hash);
+
+// Move the dependencies of a freshly compiled object from its .d file into the
+// deps log, along with the hash of the command that compiled it.
 //
-// Returns true if the object file needs to be compiled.
-bool build_should_compile_object(const char *object);
+// With `content_hash` a fingerprint of every dependency is recorded. A
+// fingerprint is the last-modified time, size and content hash of a file. The
+// last-modified time and size are used as a cheap check, and the content is
+// only hashed when they differ.
+bool build_record_deps(DepsLog *log, const char *object, Hash command,
+                       bool content_hash);
 
 // This file is part of Lute.
 // Copyright (C) 2024  Hjalte C. Nannestad
@@ -0,0 +1,160 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#include <stdio.h>
+
+#include "argp.h"
+#include "cache.h"
+#include "fs.h"
+#include "log.h"
+#include "objcache.h"
+
+void print_cache_usage() {
+    INFO("Usage: lute cache [command] [options]\n"
+         "\n"
+         "Commands:\n"
+         "  stats (default)   Show statistics of the object cache\n"
+         "  clear             Remove the objects, manifests and statistics of the\n"
+         "                    object cache\n"
+         "\n"
+         "Options:\n"
+         "  -h, --help        Show this help message\n");
+}
+
+void print_cache_help() {
+    INFO("Manage the object cache\n");
+    INFO("Version: %s\n\n", VERSION);
+    print_cache_usage();
+}
+
+CacheOptions cache_options_default() {
+    CacheOptions options = {0};
+
+    options.help = false;
+    options.action = CACHE_STATS;
+
+    return options;
+}
+
+bool cache_options_parse(CacheOptions *options, int argc, char **argv,
+                         int *argi) {
+
+    while (*argi < argc) {
+        char *arg = argv[(*argi)++];
+
+        if (arg_is(arg, "-h", "--help")) {
+            options->help = true;
+        } else if (arg_is(arg, NULL, "stats")) {
+            options->action = CACHE_STATS;
+        } else if (arg_is(arg, NULL, "clear")) {
+            options->action = CACHE_CLEAR;
+        } else {
+            ERROR("Unknown option: %s\n", arg);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void print_size(const char *label, int64_t size) {
+    const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    double value = size;
+    size_t unit = 0;
+
+    while (value >= 1024 && unit < sizeof(units) / sizeof(units[0]) - 1) {
+        value /= 1024;
+        unit++;
+    }
+
+    INFO("%s%.1f %s\n", label, value, units[unit]);
+}
+
+static int cache_stats(const char *dir) {
+    ObjectCacheStats stats;
+
+    if (!object_cache_stats(dir, &stats)) {
+        INFO("Cache directory: %s (empty)\n", dir);
+        return 0;
+    }
+
+    size_t lookups = stats.hits + stats.misses;
+
+    INFO("Cache directory: %s\n", dir);
+    INFO("Hits:            %zu\n", stats.hits);
+    INFO("Misses:          %zu\n", stats.misses);
+    INFO("Hit rate:        %.1f%%\n",
+         lookups ? 100.0 * stats.hits / lookups : 0.0);
+    INFO("Objects:         %zu\n", stats.objects);
+    print_size("Size:            ", stats.size);
+
+    return 0;
+}
+
+// Remove what `object_cache_open` creates, the directory itself may be shared
+// through LUTE_CACHE_DIR.
+static int cache_clear(const char *dir) {
+    const char *entries[] = {"manifests", "objects", "stats"};
+    int code = 0;
+
+    for (size_t i = 0; i < sizeof(entries) / sizeof(entries[0]); i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", dir, entries[i]);
+
+        if (!file_exists(path)) {
+            continue;
+        }
+
+        INFO("Removing %s\n", path);
+
+        if (!remove_dir(path)) {
+            ERROR("Error: Could not remove %s\n", path);
+            code = 1;
+        }
+    }
+
+    return code;
+}
+
+int cache_command(int argc, char **argv, int *argi) {
+    CacheOptions options = cache_options_default();
+
+    if (!cache_options_parse(&options, argc, argv, argi)) {
+        INFO("\n");
+        print_cache_usage();
+        return 1;
+    }
+
+    if (options.help) {
+        print_cache_help();
+        return 0;
+    }
+
+    char dir[256];
+    object_cache_dir(dir, sizeof(dir));
+
+    switch (options.action) {
+    case CACHE_STATS:
+        return cache_stats(dir);
+    case CACHE_CLEAR:
+        return cache_clear(dir);
+    }
+
+    return 1;
+}
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
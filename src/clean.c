@@ -1,7 +1,9 @@
 // Copyright (C) 2024  Hjalte C. Nannestad
 // See end of file for license information.
 
+#include <dirent.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "argp.h"
 #include "clean.h"
@@ -12,7 +14,8 @@ void print_clean_usage() {
     INFO("Usage: lute clean [options]\n"
          "\n"
          "Options:\n"
-         "  -h, --help        Show this help message\n");
+         "  -h, --help        Show this help message\n"
+         "  -a, --all         Also remove the object cache\n");
 }
 
 void print_clean_help() {
@@ -25,6 +28,7 @@ CleanOptions clean_options_default() {
     CleanOptions options = {0};
 
     options.help = false;
+    options.all = false;
 
     return options;
 }
@@ -37,6 +41,8 @@ bool clean_options_parse(CleanOptions *options, int argc, char **argv,
 
         if (arg_is(arg, "-h", "--help")) {
             options->help = true;
+        } else if (arg_is(arg, "-a", "--all")) {
+            options->all = true;
         } else {
             ERROR("Unknown option: %s\n", arg);
             return false;
@@ -46,6 +52,31 @@ bool clean_options_parse(CleanOptions *options, int argc, char **argv,
     return true;
 }
 
+// Remove everything in lute-cache except the object cache.
+static void clean_cache() {
+    DIR *dir = opendir("lute-cache");
+
+    if (!dir) {
+        return;
+    }
+
+    struct dirent *entry;
+
+    while ((entry = readdir(dir))) {
+        if (strcmp(entry->d_name, ".") == 0 ||
+            strcmp(entry->d_name, "..") == 0 ||
+            strcmp(entry->d_name, "objects") == 0) {
+            continue;
+        }
+
+        char path[512];
+        snprintf(path, sizeof(path), "lute-cache/%s", entry->d_name);
+        remove_dir(path);
+    }
+
+    closedir(dir);
+}
+
 int clean_command(int argc, char **argv, int *argi) {
     CleanOptions options = clean_options_default();
 
@@ -67,9 +98,12 @@ int clean_command(int argc, char **argv, int *argi) {
         remove_dir("lute-out");
     }
 
-    if (file_exists("lute-cache")) {
+    if (file_exists("lute-cache") && options.all) {
         INFO("Removing lute-cache\n");
         remove_dir("lute-cache");
+    } else if (file_exists("lute-cache")) {
+        INFO("Removing lute-cache, keeping the object cache\n");
+        clean_cache();
     }
 
     return 0;
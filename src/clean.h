@@ -7,6 +7,9 @@
 
 typedef struct {
     bool help;
+
+    // Also remove the object cache in lute-cache.
+    bool all;
 } CleanOptions;
 
 CleanOptions clean_options_default();
@@ -0,0 +1,123 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "depfile.h"
+#include "fs.h"
+
+static bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+static bool is_continuation(const char *p) {
+    return p[0] == '\\' && (p[1] == '\n' || (p[1] == '\r' && p[2] == '\n'));
+}
+
+// Read a single word, unescaping `\ `, `\#` and `$$`.
+static const char *read_word(const char *p, char *word) {
+    size_t len = 0;
+
+    while (*p && !is_blank(*p) && *p != '\n' && !is_continuation(p)) {
+        if (p[0] == '\\' && (p[1] == ' ' || p[1] == '#')) {
+            word[len++] = p[1];
+            p += 2;
+        } else if (p[0] == '$' && p[1] == '$') {
+            word[len++] = '$';
+            p += 2;
+        } else {
+            word[len++] = *p++;
+        }
+    }
+
+    word[len] = '\0';
+
+    return p;
+}
+
+bool depfile_parse(const char *path, char **target, Strings *deps) {
+    char *data;
+
+    if (!read_file(path, &data)) {
+        return false;
+    }
+
+    char *word = malloc(strlen(data) + 1);
+    const char *p = data;
+
+    // 0: reading the target, 1: expecting a colon, 2: reading prerequisites
+    int state = 0;
+    *target = NULL;
+
+    while (*p) {
+        if (is_blank(*p)) {
+            p++;
+            continue;
+        }
+
+        if (is_continuation(p)) {
+            p += p[1] == '\n' ? 2 : 3;
+            continue;
+        }
+
+        if (*p == '\n') {
+            // only the first rule is of interest
+            if (state == 2)
+                break;
+
+            p++;
+            continue;
+        }
+
+        p = read_word(p, word);
+        size_t len = strlen(word);
+
+        if (state == 0) {
+            if (len > 0 && word[len - 1] == ':') {
+                word[len - 1] = '\0';
+                state = 2;
+            } else {
+                state = 1;
+            }
+
+            *target = strdup(word);
+        } else if (state == 1) {
+            if (strcmp(word, ":") != 0)
+                break;
+
+            state = 2;
+        } else {
+            vec_push(deps, strdup(word));
+        }
+    }
+
+    free(word);
+    free(data);
+
+    if (state != 2) {
+        free(*target);
+        *target = NULL;
+
+        vec_foreach(deps, dep) free(dep);
+        vec_free(deps);
+
+        return false;
+    }
+
+    return true;
+}
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
@@ -0,0 +1,31 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include <lute/target.h>
+
+// Parse a make-style dependency file, as written by the compiler with `-MD`.
+//
+// Sets `target` to the target of the first rule, and pushes every prerequisite
+// of that rule to `deps`. Escaped spaces and line continuations are handled,
+// and there is no limit on the length of paths or lines.
+bool depfile_parse(const char *path, char **target, Strings *deps);
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
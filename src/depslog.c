@@ -0,0 +1,460 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "depslog.h"
+#include "log.h"
+
+#define DEPS_LOG_MAGIC "LUTEDEPS"
+#define DEPS_LOG_VERSION 3
+
+#define RECORD_PATH 0
+#define RECORD_DEPS 1
+
+#define RECORD_HASHED (1 << 0)
+
+// record:       u32 kind, u32 size, u8 payload[size]
+// path payload: char path[size], null padded to a multiple of 4
+// deps payload: u32 output, u32 flags, u32 count, u32 pad, hash command,
+//               entry[count]
+// entry:        u32 path, u32 pad, i64 mtime, i64 size, hash
+#define RECORD_HEADER_SIZE 8
+#define DEPS_HEADER_SIZE (16 + sizeof(Hash))
+#define ENTRY_SIZE (24 + sizeof(Hash))
+
+static uint32_t read_u32(const uint8_t *data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static int64_t read_i64(const uint8_t *data) {
+    int64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static void write_u32(uint8_t *data, uint32_t value) {
+    memcpy(data, &value, sizeof(value));
+}
+
+static void write_i64(uint8_t *data, int64_t value) {
+    memcpy(data, &value, sizeof(value));
+}
+
+void deps_record_init(DepsRecord *record) {
+    record->command = (Hash){0};
+    record->hashed = false;
+    vec_init(&record->deps);
+}
+
+void deps_record_free(DepsRecord *record) { vec_free(&record->deps); }
+
+static size_t deps_log_slot(const DepsLog *log, const char *path) {
+    size_t mask = log->table_cap - 1;
+    size_t slot = hash_bytes(path, strlen(path)).lo & mask;
+
+    while (log->table[slot]) {
+        const char *other = log->nodes.data[log->table[slot] - 1].path;
+
+        if (strcmp(other, path) == 0)
+            break;
+
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+static void deps_log_grow(DepsLog *log) {
+    free(log->table);
+
+    log->table_cap = log->table_cap ? log->table_cap * 2 : 1024;
+    log->table = calloc(log->table_cap, sizeof(uint32_t));
+
+    for (size_t i = 0; i < log->nodes.len; i++) {
+        size_t slot = deps_log_slot(log, log->nodes.data[i].path);
+        log->table[slot] = i + 1;
+    }
+}
+
+// Add a path that is known not to be in the log yet.
+static uint32_t deps_log_add_node(DepsLog *log, const char *path) {
+    if ((log->nodes.len + 1) * 2 > log->table_cap) {
+        deps_log_grow(log);
+    }
+
+    DepsNode node = {.path = path, .record = NULL};
+    vec_push(&log->nodes, node);
+
+    uint32_t id = log->nodes.len - 1;
+    log->table[deps_log_slot(log, path)] = id + 1;
+
+    return id;
+}
+
+static bool deps_log_find(DepsLog *log, const char *path, uint32_t *id) {
+    if (!log->table_cap) {
+        return false;
+    }
+
+    uint32_t entry = log->table[deps_log_slot(log, path)];
+
+    if (!entry) {
+        return false;
+    }
+
+    *id = entry - 1;
+
+    return true;
+}
+
+static bool write_record(FILE *file, uint32_t kind, const void *payload,
+                         uint32_t size) {
+    uint8_t header[RECORD_HEADER_SIZE];
+    write_u32(header, kind);
+    write_u32(header + 4, size);
+
+    return fwrite(header, sizeof(header), 1, file) == 1 &&
+           fwrite(payload, size, 1, file) == 1;
+}
+
+static bool write_path_record(FILE *file, const char *path) {
+    size_t len = strlen(path);
+    size_t size = (len + 4) & ~(size_t)3;
+
+    uint8_t *payload = calloc(size, 1);
+    memcpy(payload, path, len);
+
+    bool success = write_record(file, RECORD_PATH, payload, size);
+    free(payload);
+
+    return success;
+}
+
+static bool write_deps_record(FILE *file, const uint8_t *record) {
+    uint32_t size = read_u32(record + 4);
+    return fwrite(record, RECORD_HEADER_SIZE + size, 1, file) == 1;
+}
+
+static bool write_header(FILE *file) {
+    uint32_t version = DEPS_LOG_VERSION;
+
+    return fwrite(DEPS_LOG_MAGIC, 8, 1, file) == 1 &&
+           fwrite(&version, sizeof(version), 1, file) == 1;
+}
+
+// Read the mapped log into the path table.
+//
+// Returns the size of the valid prefix of the log.
+static size_t deps_log_load(DepsLog *log) {
+    const size_t header = 8 + sizeof(uint32_t);
+
+    if (log->size < header || memcmp(log->data, DEPS_LOG_MAGIC, 8) != 0 ||
+        read_u32(log->data + 8) != DEPS_LOG_VERSION) {
+        return 0;
+    }
+
+    size_t offset = header;
+
+    while (offset + RECORD_HEADER_SIZE <= log->size) {
+        const uint8_t *record = log->data + offset;
+        uint32_t kind = read_u32(record);
+        uint32_t size = read_u32(record + 4);
+        const uint8_t *payload = record + RECORD_HEADER_SIZE;
+
+        // a partially written record is dropped
+        if (size > log->size - offset - RECORD_HEADER_SIZE)
+            break;
+
+        if (kind == RECORD_PATH) {
+            if (size == 0 || payload[size - 1] != '\0')
+                break;
+
+            deps_log_add_node(log, (const char *)payload);
+        } else if (kind == RECORD_DEPS) {
+            if (size < DEPS_HEADER_SIZE)
+                break;
+
+            uint32_t output = read_u32(payload);
+            uint32_t count = read_u32(payload + 8);
+
+            if (output >= log->nodes.len ||
+                size != DEPS_HEADER_SIZE + count * ENTRY_SIZE)
+                break;
+
+            log->nodes.data[output].record = record;
+            log->records++;
+        } else {
+            break;
+        }
+
+        offset += RECORD_HEADER_SIZE + size;
+    }
+
+    return offset;
+}
+
+// Rewrite the log with only the latest record of every output.
+static bool deps_log_recompact(DepsLog *log) {
+    char *temp = malloc(strlen(log->path) + 8);
+    sprintf(temp, "%s.tmp", log->path);
+
+    FILE *file = fopen(temp, "wb");
+
+    if (!file) {
+        free(temp);
+        return false;
+    }
+
+    bool success = write_header(file);
+
+    vec_foreachat(&log->nodes, node) {
+        success = success && write_path_record(file, node->path);
+    }
+
+    size_t records = 0;
+
+    vec_foreachat(&log->nodes, node) {
+        if (!node->record)
+            continue;
+
+        success = success && write_deps_record(file, node->record);
+        records++;
+    }
+
+    success = fclose(file) == 0 && success;
+    success = success && rename(temp, log->path) == 0;
+
+    if (!success) {
+        remove(temp);
+    } else {
+        log->records = records;
+    }
+
+    free(temp);
+
+    return success;
+}
+
+bool deps_log_open(DepsLog *log, const char *path) {
+    log->path = strdup(path);
+    log->file = NULL;
+    log->data = NULL;
+    log->size = 0;
+    log->table = NULL;
+    log->table_cap = 0;
+    log->records = 0;
+
+    vec_init(&log->nodes);
+    vec_init(&log->owned);
+
+    deps_log_grow(log);
+
+    int fd = open(path, O_RDONLY);
+    size_t valid = 0;
+
+    if (fd >= 0) {
+        struct stat st;
+
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *data =
+                mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data != MAP_FAILED) {
+                log->data = data;
+                log->size = st.st_size;
+            }
+        }
+
+        close(fd);
+    }
+
+    if (log->data) {
+        valid = deps_log_load(log);
+    }
+
+    size_t live = 0;
+    vec_foreachat(&log->nodes, node) live += node->record != NULL;
+
+    if (valid > 0 && log->records > 1000 && log->records > live * 3) {
+        // the mapping stays valid after the file is replaced
+        deps_log_recompact(log);
+    } else if (valid == 0) {
+        // the log is missing, corrupt or of another version
+        vec_foreachat(&log->nodes, node) node->record = NULL;
+        log->nodes.len = 0;
+        memset(log->table, 0, log->table_cap * sizeof(uint32_t));
+        log->records = 0;
+
+        FILE *file = fopen(path, "wb");
+
+        if (!file || !write_header(file)) {
+            ERROR("Error: Could not create deps log %s\n", path);
+
+            if (file)
+                fclose(file);
+
+            return false;
+        }
+
+        fclose(file);
+    } else if (valid < log->size) {
+        // drop a partially written record at the end
+        if (truncate(path, valid) != 0) {
+            ERROR("Error: Could not repair deps log %s\n", path);
+            return false;
+        }
+    }
+
+    log->file = fopen(path, "ab");
+
+    if (!log->file) {
+        ERROR("Error: Could not open deps log %s\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+void deps_log_close(DepsLog *log) {
+    if (log->file) {
+        fclose(log->file);
+    }
+
+    if (log->data) {
+        munmap(log->data, log->size);
+    }
+
+    vec_foreach(&log->owned, owned) free(owned);
+    vec_free(&log->owned);
+    vec_free(&log->nodes);
+
+    free(log->table);
+    free(log->path);
+}
+
+bool deps_log_get(DepsLog *log, const char *output, DepsRecord *record) {
+    uint32_t id;
+
+    if (!deps_log_find(log, output, &id) || !log->nodes.data[id].record) {
+        return false;
+    }
+
+    const uint8_t *payload = log->nodes.data[id].record + RECORD_HEADER_SIZE;
+    uint32_t flags = read_u32(payload + 4);
+    uint32_t count = read_u32(payload + 8);
+
+    memcpy(&record->command, payload + 16, sizeof(Hash));
+    record->hashed = flags & RECORD_HASHED;
+    record->deps.len = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *entry = payload + DEPS_HEADER_SIZE + i * ENTRY_SIZE;
+
+        uint32_t path = read_u32(entry);
+
+        if (path >= log->nodes.len) {
+            return false;
+        }
+
+        DepsEntry dep;
+        dep.path = log->nodes.data[path].path;
+        dep.mtime = read_i64(entry + 8);
+        dep.size = read_i64(entry + 16);
+        memcpy(&dep.hash, entry + 24, sizeof(Hash));
+
+        vec_push(&record->deps, dep);
+    }
+
+    return true;
+}
+
+// Get the id of a path, writing a path record if it is new.
+static bool deps_log_intern(DepsLog *log, const char *path, uint32_t *id) {
+    if (deps_log_find(log, path, id)) {
+        return true;
+    }
+
+    if (!write_path_record(log->file, path)) {
+        return false;
+    }
+
+    char *copy = strdup(path);
+    vec_push(&log->owned, copy);
+
+    *id = deps_log_add_node(log, copy);
+
+    return true;
+}
+
+bool deps_log_record(DepsLog *log, const char *output,
+                     const DepsRecord *record) {
+    uint32_t output_id;
+
+    if (!deps_log_intern(log, output, &output_id)) {
+        return false;
+    }
+
+    size_t size = DEPS_HEADER_SIZE + record->deps.len * ENTRY_SIZE;
+    uint8_t *data = calloc(RECORD_HEADER_SIZE + size, 1);
+    uint8_t *payload = data + RECORD_HEADER_SIZE;
+
+    write_u32(data, RECORD_DEPS);
+    write_u32(data + 4, size);
+
+    write_u32(payload, output_id);
+    write_u32(payload + 4, record->hashed ? RECORD_HASHED : 0);
+    write_u32(payload + 8, record->deps.len);
+    memcpy(payload + 16, &record->command, sizeof(Hash));
+
+    for (size_t i = 0; i < record->deps.len; i++) {
+        const DepsEntry *dep = &record->deps.data[i];
+        uint8_t *entry = payload + DEPS_HEADER_SIZE + i * ENTRY_SIZE;
+
+        uint32_t id;
+
+        if (!deps_log_intern(log, dep->path, &id)) {
+            free(data);
+            return false;
+        }
+
+        write_u32(entry, id);
+        write_i64(entry + 8, dep->mtime);
+        write_i64(entry + 16, dep->size);
+        memcpy(entry + 24, &dep->hash, sizeof(Hash));
+    }
+
+    if (!write_deps_record(log->file, data)) {
+        free(data);
+        return false;
+    }
+
+    vec_push(&log->owned, data);
+    log->nodes.data[output_id].record = data;
+    log->records++;
+
+    return true;
+}
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
@@ -0,0 +1,108 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <lute/vector.h>
+
+#include "hash.h"
+
+// A dependency of an output, as it was when the output was built.
+typedef struct {
+    // The interned path of the dependency.
+    const char *path;
+
+    // The last-modified time of the dependency in nanoseconds.
+    int64_t mtime;
+
+    // The size of the dependency.
+    int64_t size;
+
+    // The content hash of the dependency, only set if the record is hashed.
+    Hash hash;
+} DepsEntry;
+
+typedef Vec(DepsEntry) DepsEntries;
+
+// The recorded dependencies of an output.
+typedef struct {
+    // The hash of the command that built the output, see `args_hash`.
+    Hash command;
+
+    // Whether the content hashes of the dependencies were recorded.
+    bool hashed;
+
+    DepsEntries deps;
+} DepsRecord;
+
+void deps_record_init(DepsRecord *record);
+void deps_record_free(DepsRecord *record);
+
+typedef struct {
+    // The interned path.
+    const char *path;
+
+    // The latest deps record of the path as an output, or NULL.
+    const uint8_t *record;
+} DepsNode;
+
+// A persistent log of the dependencies of build outputs.
+//
+// The log is a single binary file. Every path is written once and referred to
+// by its index afterwards, and deps records are appended whenever an output is
+// built, where the last record of an output wins. The file is memory-mapped
+// when opened, and rewritten without stale records once they dominate it.
+typedef struct {
+    char *path;
+    FILE *file;
+
+    // The memory-mapped contents of the log when it was opened.
+    uint8_t *data;
+    size_t size;
+
+    // All known paths, indexed by their id.
+    Vec(DepsNode) nodes;
+
+    // Open addressing table of path ids + 1, 0 is an empty slot.
+    uint32_t *table;
+    size_t table_cap;
+
+    // Paths and records added since the log was opened.
+    Vec(void *) owned;
+
+    // The number of deps records in the file.
+    size_t records;
+} DepsLog;
+
+// Open a deps log, creating it if it does not exist.
+bool deps_log_open(DepsLog *log, const char *path);
+void deps_log_close(DepsLog *log);
+
+// Get the recorded dependencies of an output.
+//
+// Returns false if nothing is recorded for the output.
+bool deps_log_get(DepsLog *log, const char *output, DepsRecord *record);
+
+// Record the dependencies of an output.
+bool deps_log_record(DepsLog *log, const char *output,
+                     const DepsRecord *record);
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
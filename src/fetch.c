@@ -0,0 +1,102 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#include <stdio.h>
+
+#include "argp.h"
+#include "fetch.h"
+#include "graph.h"
+#include "jobs.h"
+#include "log.h"
+
+void print_fetch_usage() {
+    INFO("Usage: lute fetch [options]\n"
+         "\n"
+         "Options:\n"
+         "  -h, --help        Show this help message\n"
+         "  -j, --jobs <n>    Fetch n dependencies in parallel\n");
+}
+
+void print_fetch_help() {
+    INFO("Fetch every dependency of the project\n");
+    INFO("Version: %s\n\n", VERSION);
+    print_fetch_usage();
+}
+
+FetchOptions fetch_options_default() {
+    FetchOptions options = {0};
+
+    options.help = false;
+    options.jobs = default_fetch_jobs();
+
+    return options;
+}
+
+bool fetch_options_parse(FetchOptions *options, int argc, char **argv,
+                         int *argi) {
+
+    while (*argi < argc) {
+        char *arg = argv[(*argi)++];
+
+        if (arg_is(arg, "-h", "--help")) {
+            options->help = true;
+        } else if (arg_is(arg, "-j", "--jobs")) {
+            char *jobs = *argi < argc ? argv[(*argi)++] : NULL;
+
+            if (!parse_jobs(jobs, &options->jobs)) {
+                ERROR("Invalid job count: %s\n", jobs ? jobs : "");
+                return false;
+            }
+        } else {
+            ERROR("Unknown option: %s\n", arg);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int fetch_command(int argc, char **argv, int *argi) {
+    FetchOptions options = fetch_options_default();
+
+    if (!fetch_options_parse(&options, argc, argv, argi)) {
+        INFO("\n");
+        print_fetch_usage();
+        return 1;
+    }
+
+    if (options.help) {
+        print_fetch_help();
+        return 0;
+    }
+
+    BuildGraph graph;
+
+    if (!build_graph_load_jobs(&graph, options.jobs)) {
+        ERROR("Error: Could not fetch dependencies\n");
+        return 1;
+    }
+
+    // every node but the root is a dependency repository
+    INFO("Fetched %zu dependencies\n", graph.nodes.len - 1);
+
+    build_graph_free(&graph);
+
+    return 0;
+}
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
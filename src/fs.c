@@ -2,6 +2,7 @@
 // See end of file for license information.
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,21 +10,154 @@
 #include <unistd.h>
 
 #include "fs.h"
+#include "hash.h"
+
+typedef struct {
+    char *path;
+    bool exists;
+    FileStat st;
+    bool hashed;
+    Hash hash;
+} StatEntry;
+
+// Open addressing table of stat results, including failed ones.
+static struct {
+    StatEntry *entries;
+    size_t len;
+    size_t cap;
+} stat_cache = {0};
+
+static size_t stat_cache_slot(const char *path) {
+    size_t mask = stat_cache.cap - 1;
+    size_t slot = hash_bytes(path, strlen(path)).lo & mask;
+
+    while (stat_cache.entries[slot].path &&
+           strcmp(stat_cache.entries[slot].path, path) != 0) {
+        slot = (slot + 1) & mask;
+    }
 
-bool file_exists(const char *path) {
-    struct stat st = {0};
+    return slot;
+}
 
-    return stat(path, &st) == 0;
+static void stat_cache_grow() {
+    StatEntry *entries = stat_cache.entries;
+    size_t cap = stat_cache.cap;
+
+    stat_cache.cap = cap ? cap * 2 : 256;
+    stat_cache.entries = calloc(stat_cache.cap, sizeof(StatEntry));
+
+    for (size_t i = 0; i < cap; i++) {
+        if (entries[i].path) {
+            stat_cache.entries[stat_cache_slot(entries[i].path)] = entries[i];
+        }
+    }
+
+    free(entries);
 }
 
-bool is_dir(const char *path) {
-    struct stat st = {0};
+static void stat_uncached(const char *path, StatEntry *entry) {
+    struct stat s = {0};
+
+    entry->exists = stat(path, &s) == 0;
+    entry->hashed = false;
+
+    if (entry->exists) {
+        entry->st.mtime =
+            (int64_t)s.st_mtim.tv_sec * 1000000000 + s.st_mtim.tv_nsec;
+        entry->st.size = s.st_size;
+        entry->st.is_dir = S_ISDIR(s.st_mode);
+    }
+}
 
-    if (stat(path, &st) == 0) {
-        return S_ISDIR(st.st_mode);
+void stat_cache_forget(const char *path) {
+    if (!stat_cache.cap) {
+        return;
     }
 
-    return false;
+    size_t mask = stat_cache.cap - 1;
+    size_t slot = stat_cache_slot(path);
+
+    if (!stat_cache.entries[slot].path) {
+        return;
+    }
+
+    free(stat_cache.entries[slot].path);
+    stat_cache.entries[slot].path = NULL;
+    stat_cache.len--;
+
+    // reinsert the rest of the cluster so lookups do not stop at the hole
+    for (slot = (slot + 1) & mask; stat_cache.entries[slot].path;
+         slot = (slot + 1) & mask) {
+        StatEntry entry = stat_cache.entries[slot];
+        stat_cache.entries[slot].path = NULL;
+        stat_cache.entries[stat_cache_slot(entry.path)] = entry;
+    }
+}
+
+void stat_cache_clear() {
+    for (size_t i = 0; i < stat_cache.cap; i++) {
+        free(stat_cache.entries[i].path);
+    }
+
+    free(stat_cache.entries);
+
+    stat_cache.entries = NULL;
+    stat_cache.len = 0;
+    stat_cache.cap = 0;
+}
+
+static StatEntry *stat_cache_get(const char *path) {
+    if ((stat_cache.len + 1) * 2 > stat_cache.cap) {
+        stat_cache_grow();
+    }
+
+    StatEntry *entry = &stat_cache.entries[stat_cache_slot(path)];
+
+    if (!entry->path) {
+        entry->path = strdup(path);
+        stat_uncached(path, entry);
+        stat_cache.len++;
+    }
+
+    return entry;
+}
+
+bool file_stat(const char *path, FileStat *st) {
+    StatEntry *entry = stat_cache_get(path);
+
+    if (entry->exists) {
+        *st = entry->st;
+    }
+
+    return entry->exists;
+}
+
+bool file_hash(const char *path, Hash *hash) {
+    StatEntry *entry = stat_cache_get(path);
+
+    if (!entry->exists) {
+        return false;
+    }
+
+    if (!entry->hashed) {
+        entry->hashed = hash_file(path, &entry->hash);
+    }
+
+    *hash = entry->hash;
+
+    return entry->hashed;
+}
+
+bool file_exists(const char *path) {
+    FileStat st;
+
+    return file_stat(path, &st);
+}
+
+bool is_dir(const char *path) {
+    FileStat st;
+
+    return file_stat(path, &st) && st.is_dir;
 }
 
 bool make_dir(const char *path) {
@@ -31,6 +165,8 @@ bool make_dir(const char *path) {
         return true;
     }
 
+    stat_cache_forget(path);
+
     return mkdir(path, 0755) == 0;
 }
 
@@ -55,28 +191,33 @@ bool make_dirs(const char *path) {
 }
 
 bool read_file(const char *path, char **data) {
+    size_t size;
+    return read_file_size(path, data, &size);
+}
+
+bool read_file_size(const char *path, char **data, size_t *size) {
     FILE *file = fopen(path, "r");
     if (!file) {
         return false;
     }
 
     fseek(file, 0, SEEK_END);
-    size_t size = ftell(file);
+    *size = ftell(file);
     fseek(file, 0, SEEK_SET);
 
-    *data = malloc(size + 1);
+    *data = malloc(*size + 1);
     if (!*data) {
         fclose(file);
         return false;
     }
 
-    if (fread(*data, sizeof(char), size, file) != size) {
+    if (fread(*data, sizeof(char), *size, file) != *size) {
         fclose(file);
         free(*data);
         return false;
     }
 
-    (*data)[size] = '\0';
+    (*data)[*size] = '\0';
 
     fclose(file);
 
@@ -84,18 +225,73 @@ bool read_file(const char *path, char **data) {
 }
 
 bool copy_file(const char *src, const char *dst) {
-    char cmd[512];
-    sprintf(cmd, "cp %s %s", src, dst);
-    return system(cmd) == 0;
+    stat_cache_forget(dst);
+
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+
+    if (in < 0) {
+        return false;
+    }
+
+    struct stat s;
+
+    if (fstat(in, &s) != 0) {
+        close(in);
+        return false;
+    }
+
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp%d", dst, (int)getpid());
+
+    int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                   s.st_mode & 0777);
+
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+
+    char buffer[65536];
+    ssize_t n = 0;
+    bool success = true;
+
+    while (success && (n = read(in, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t written = 0; written < n;) {
+            ssize_t w = write(out, buffer + written, n - written);
+
+            if (w < 0) {
+                success = false;
+                break;
+            }
+
+            written += w;
+        }
+    }
+
+    success = success && n == 0;
+
+    close(in);
+    success = close(out) == 0 && success;
+
+    if (!success || rename(tmp, dst) != 0) {
+        remove(tmp);
+        return false;
+    }
+
+    return true;
 }
 
 bool copy_files(const char *src, const char *dst) {
+    stat_cache_clear();
+
     char cmd[512];
     sprintf(cmd, "cp -r %s/* %s", src, dst);
     return system(cmd) == 0;
 }
 
 bool remove_dir(const char *path) {
+    stat_cache_clear();
+
     if (!is_dir(path)) {
         remove(path);
         return true;
@@ -133,10 +329,10 @@ bool remove_dir(const char *path) {
 }
 
 bool last_modified(const char *path, time_t *time) {
-    struct stat st = {0};
+    FileStat st;
 
-    if (stat(path, &st) == 0) {
-        *time = st.st_mtime;
+    if (file_stat(path, &st)) {
+        *time = st.mtime / 1000000000;
         return true;
     }
 
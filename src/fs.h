@@ -4,14 +4,52 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
+#include "hash.h"
+
+typedef struct {
+    // The last-modified time in nanoseconds.
+    int64_t mtime;
+    int64_t size;
+    bool is_dir;
+} FileStat;
+
+// Get the last-modified time, size and kind of a file.
+//
+// Results, including missing files, are cached for the rest of the process, so
+// each path is only stat'ed once. `file_exists`, `is_dir` and `last_modified`
+// go through the same cache.
+bool file_stat(const char *path, FileStat *st);
+
+// Hash the contents of a file.
+//
+// The hash is cached along with the stat of the file, and only recomputed if
+// the file is forgotten.
+bool file_hash(const char *path, Hash *hash);
+
+// Forget the cached stat of a path, eg. after writing to it.
+void stat_cache_forget(const char *path);
+
+// Forget every cached stat.
+void stat_cache_clear();
+
 bool file_exists(const char *path);
 bool is_dir(const char *path);
 bool make_dir(const char *path);
 bool make_dirs(const char *path);
 bool read_file(const char *path, char **data);
+
+// Read a file like `read_file`, and get the number of bytes read.
+bool read_file_size(const char *path, char **data, size_t *size);
+
+// Copy a file and its permissions.
+//
+// The copy is written next to `dst` and renamed over it, so `dst` is never
+// seen half written.
 bool copy_file(const char *src, const char *dst);
+
 bool copy_files(const char *src, const char *dst);
 bool remove_dir(const char *path);
 bool last_modified(const char *path, time_t *time);
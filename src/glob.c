@@ -0,0 +1,95 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#include <fnmatch.h>
+#include <limits.h>
+#include <string.h>
+
+#include "glob.h"
+
+static const char *glob_segment_end(const char *segment) {
+    const char *end = strchr(segment, '/');
+    return end ? end : segment + strlen(segment);
+}
+
+static const char *glob_segment_next(const char *end) {
+    return *end ? end + 1 : end;
+}
+
+static bool glob_segment_match(const char *pattern, const char *pattern_end,
+                               const char *path, const char *path_end) {
+    char pattern_segment[NAME_MAX + 1];
+    char path_segment[NAME_MAX + 1];
+
+    size_t pattern_len = pattern_end - pattern;
+    size_t path_len = path_end - path;
+
+    if (pattern_len > NAME_MAX || path_len > NAME_MAX) {
+        return false;
+    }
+
+    memcpy(pattern_segment, pattern, pattern_len);
+    pattern_segment[pattern_len] = '\0';
+    memcpy(path_segment, path, path_len);
+    path_segment[path_len] = '\0';
+
+    return fnmatch(pattern_segment, path_segment, 0) == 0;
+}
+
+// Match the segments of a pattern against the segments of a path.
+//
+// With `partial`, a path that runs out before the pattern matches, as paths
+// below it may still match the rest.
+static bool glob_match_segments(const char *pattern, const char *path,
+                                bool partial) {
+    if (!*pattern) {
+        return !*path;
+    }
+
+    const char *pattern_end = glob_segment_end(pattern);
+    const char *pattern_next = glob_segment_next(pattern_end);
+
+    if (pattern_end - pattern == 2 && strncmp(pattern, "**", 2) == 0) {
+        if (glob_match_segments(pattern_next, path, partial)) {
+            return true;
+        }
+
+        return *path && glob_match_segments(
+                            pattern, glob_segment_next(glob_segment_end(path)),
+                            partial);
+    }
+
+    if (!*path) {
+        return partial;
+    }
+
+    const char *path_end = glob_segment_end(path);
+
+    return glob_segment_match(pattern, pattern_end, path, path_end) &&
+           glob_match_segments(pattern_next, glob_segment_next(path_end),
+                               partial);
+}
+
+bool glob_match(const char *pattern, const char *path) {
+    return glob_match_segments(pattern, path, false);
+}
+
+bool glob_match_dir(const char *pattern, const char *dir) {
+    return glob_match_segments(pattern, dir, true);
+}
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
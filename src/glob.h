@@ -0,0 +1,34 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#pragma once
+
+#include <stdbool.h>
+
+// Glob patterns over relative paths.
+//
+// A pattern is matched one segment at a time, with the wildcards of `fnmatch`
+// within a segment. A `**` segment matches any number of segments, including
+// none, so `**/*.c` matches `main.c` as well as `a/b/main.c`.
+
+// Whether a path matches a pattern.
+bool glob_match(const char *pattern, const char *path);
+
+// Whether paths inside a directory can match a pattern, so it is worth reading.
+bool glob_match_dir(const char *pattern, const char *dir);
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
@@ -2,94 +2,71 @@
 // See end of file for license information.
 
 #include <assert.h>
-#include <dirent.h>
 #include <lute/build.h>
+#include <unistd.h>
 
+#include "args.h"
 #include "fs.h"
+#include "glob.h"
 #include "graph.h"
+#include "jobs.h"
 #include "load.h"
 #include "log.h"
+#include "pkgconfig.h"
+#include "snapshot.h"
 
-static char *pkg_config_flags(const char *flags, const char *name) {
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd), "pkg-config --%s %s", flags, name);
+bool build_package_init(BuildPackage *package, Arena *arena,
+                        const char *name) {
+    PkgConfig config;
 
-    FILE *fp = popen(cmd, "r");
-
-    if (!fp) {
-        ERROR("Error: Could not run pkg-config\n");
-        return NULL;
-    }
-
-    char buffer[4096];
-    if (!fgets(buffer, sizeof(buffer), fp)) {
-        ERROR("Error: Could not read pkg-config output\n");
-        pclose(fp);
-        return NULL;
-    }
-
-    pclose(fp);
-
-    // remove trailing newline
-    if (buffer[strlen(buffer) - 1] == '\n') {
-        buffer[strlen(buffer) - 1] = '\0';
+    if (!pkg_config_query(&config, name)) {
+        return false;
     }
 
-    return strdup(buffer);
-}
-
-bool build_package_init(BuildPackage *package, const char *name) {
-    package->cflags = pkg_config_flags("cflags", name);
-    package->libs = pkg_config_flags("libs", name);
-    package->links = pkg_config_flags("libs-only-l", name);
+    package->name = arena_strdup(arena, name);
+    package->cflags = arena_strdup(arena, config.cflags);
+    package->libs = arena_strdup(arena, config.libs);
+    package->links = arena_strdup(arena, config.links);
 
-    if (!package->cflags || !package->libs || !package->links) {
-        free(package->cflags);
-        free(package->libs);
-        free(package->links);
-        return false;
+    vec_init(&package->files);
+    vec_foreach(&config.files, file) {
+        arena_push(arena, &package->files, arena_strdup(arena, file));
     }
 
-    package->name = strdup(name);
+    pkg_config_free(&config);
 
     return true;
 }
 
-void build_package_free(BuildPackage *package) {
-    free(package->name);
-    free(package->cflags);
-    free(package->libs);
-}
-
-void build_target_free(BuildTarget *target) {
-    free(target->name);
-
-    vec_foreach(&target->packages, package) free(package);
+void build_node_init(BuildNode *node) {
+    vec_init(&node->targets);
+    map_init(&node->names);
 }
 
-void build_node_init(BuildNode *node) { vec_init(&node->targets); }
+void build_node_free(BuildNode *node) { map_free(&node->names); }
 
-void build_node_free(BuildNode *node) {
-    vec_foreachat(&node->targets, target) build_target_free(target);
-    vec_free(&node->targets);
+void build_node_add_target(BuildNode *node, Arena *arena,
+                           BuildTarget target) {
+    // the name is allocated on its own, so it stays put when targets grows
+    map_put(&node->names, target.name, node->targets.len);
+    arena_push(arena, &node->targets, target);
 }
 
 BuildTarget *build_node_target(BuildNode *node, const char *name) {
-    vec_foreachat(&node->targets, target) {
-        if (strcmp(target->name, name) == 0)
-            return target;
-    }
+    size_t *index = map_get(&node->names, name);
 
-    return NULL;
+    return index ? &node->targets.data[*index] : NULL;
 }
 
 static bool is_url_shorthand(const char *url, const char *shorthand) {
     return memcmp(url, shorthand, strlen(shorthand)) == 0;
 }
 
-static char *expand_url_shorthand(const char *url, const char *shorthand,
+static char *expand_url_shorthand(Arena *arena, const char *url,
+                                  const char *shorthand,
                                   const char *expanded) {
-    char *out = malloc(strlen(url) + strlen(expanded) - strlen(shorthand) + 1);
+    char *out = arena_alloc(
+        arena, strlen(url) + strlen(expanded) - strlen(shorthand) + 1);
 
     strcpy(out, expanded);
     strcat(out, url + strlen(shorthand));
@@ -97,60 +74,93 @@ static char *expand_url_shorthand(const char *url, const char *shorthand,
     return out;
 }
 
-static char *expand_dep_url(const char *url) {
+static char *expand_dep_url(Arena *arena, const char *url) {
     char *github_short = "github:";
     char *github_long = "git@github.com:";
     char *gitlab_short = "gitlab:";
     char *gitlab_long = "git@gitlab.com:";
 
     if (is_url_shorthand(url, github_short))
-        return expand_url_shorthand(url, github_short, github_long);
+        return expand_url_shorthand(arena, url, github_short, github_long);
     if (is_url_shorthand(url, gitlab_short))
-        return expand_url_shorthand(url, gitlab_short, gitlab_long);
+        return expand_url_shorthand(arena, url, gitlab_short, gitlab_long);
 
-    return strdup(url);
+    return arena_strdup(arena, url);
 }
 
-void build_dep_init(BuildDep *dep, const char *url, const char *name) {
-    dep->url = expand_dep_url(url);
-    dep->name = strdup(name);
+void build_dep_init(BuildDep *dep, Arena *arena, const char *url,
+                    const char *name) {
+    dep->url = expand_dep_url(arena, url);
+    dep->name = arena_strdup(arena, name);
 
     hash_string(dep->id, "dep", dep->url);
     dep->node = NULL;
     dep->target = NULL;
 }
 
-void build_dep_free(BuildDep *dep) { free(dep->url); }
-
 void build_graph_init(BuildGraph *graph) {
+    arena_init(&graph->arena);
     vec_init(&graph->packages);
     vec_init(&graph->deps);
     vec_init(&graph->nodes);
-    vec_init(&graph->paths);
+    string_table_init(&graph->strings, &graph->arena);
+    map_init(&graph->package_names);
     graph->root = NULL;
+    vec_init(&graph->inputs);
+    graph->scans = NULL;
 }
 
 void build_graph_free(BuildGraph *graph) {
-    vec_foreach(&graph->packages, package) {
-        build_package_free(package);
-        free(package);
+    // everything but the indexes is allocated from the arena
+    vec_foreach(&graph->nodes, node) build_node_free(node);
+
+    map_free(&graph->package_names);
+    string_table_free(&graph->strings);
+    arena_free(&graph->arena);
+
+    vec_init(&graph->packages);
+    vec_init(&graph->deps);
+    vec_init(&graph->nodes);
+    vec_init(&graph->inputs);
+}
+
+// Record that the graph depends on a file or directory.
+static void build_graph_watch(BuildGraph *graph, const char *path,
+                              GraphInputKind kind) {
+    GraphInput input = {
+        .kind = kind,
+        .mtime = 0,
+        .hash = {0},
+    };
+
+    FileStat st;
+
+    if (!file_stat(path, &st)) {
+        return;
     }
 
-    vec_foreach(&graph->deps, dep) {
-        build_dep_free(dep);
-        free(dep);
+    if (kind == INPUT_MTIME) {
+        input.mtime = st.mtime;
     }
 
-    vec_foreach(&graph->nodes, node) {
-        build_node_free(node);
-        free(node);
+    if (kind == INPUT_CONTENT && !file_hash(path, &input.hash)) {
+        return;
     }
 
-    vec_foreach(&graph->paths, path) free(path);
+    input.path = arena_strdup(&graph->arena, path);
+    arena_push(&graph->arena, &graph->inputs, input);
+}
 
-    vec_free(&graph->packages);
-    vec_free(&graph->deps);
-    vec_free(&graph->nodes);
+// Record the time of a directory, as it was scanned.
+static void build_graph_watch_dir(BuildGraph *graph, const ScanDir *dir) {
+    GraphInput input = {
+        .path = arena_strdup(&graph->arena, dir->path),
+        .kind = INPUT_MTIME,
+        .mtime = dir->mtime,
+        .hash = {0},
+    };
+
+    arena_push(&graph->arena, &graph->inputs, input);
 }
 
 static char *build_add_path(BuildGraph *graph, const char *path) {
@@ -161,82 +171,119 @@ static char *build_add_path(BuildGraph *graph, const char *path) {
         return NULL;
     }
 
-    vec_foreach(&graph->paths, p) if (strcmp(p, real) == 0) return p;
-    vec_push(&graph->paths, real);
-
-    return real;
+    return string_table_take(&graph->strings, real);
 }
 
-static bool build_add_source(BuildGraph *graph, const char *path,
-                             Paths *paths) {
+// What the scan of a source keeps.
+typedef struct {
+    const Source *source;
+    const Strings *extensions;
+} SourceFilter;
 
-    if (!file_exists(path)) {
-        ERROR("Error: Could not find source %s\n", path);
+static bool has_source_extension(const char *path, const Strings *extensions) {
+    const char *ext = strrchr(path, '.');
+
+    if (!ext || strchr(ext, '/')) {
         return false;
     }
 
-    if (!is_dir(path)) {
-        char *ext = strrchr(path, '.');
+    if (extensions->len == 0) {
+        return strcmp(ext, ".c") == 0 || strcmp(ext, ".cpp") == 0;
+    }
 
-        if (!ext || (strcmp(ext, ".c") != 0 && strcmp(ext, ".cpp") != 0)) {
+    vec_foreach(extensions, extension) {
+        if (strcmp(ext, extension) == 0) {
             return true;
         }
+    }
 
-        vec_push(paths, build_add_path(graph, path));
-        return true;
+    return false;
+}
+
+static bool is_source(const char *path, bool is_dir, void *data) {
+    const SourceFilter *filter = data;
+    const char *pattern = filter->source->pattern;
+
+    vec_foreach(&filter->source->excludes, exclude) {
+        if (glob_match(exclude, path)) {
+            return false;
+        }
     }
 
-    DIR *dir = opendir(path);
+    if (is_dir) {
+        return !pattern || glob_match_dir(pattern, path);
+    }
 
-    if (!dir) {
-        ERROR("Error: Could not open directory %s\n", path);
+    return pattern ? glob_match(pattern, path)
+                   : has_source_extension(path, filter->extensions);
+}
+
+static bool build_add_source(BuildGraph *graph, const Source *source,
+                             const Strings *extensions, Paths *paths) {
+    const char *path = source->path;
+    FileStat st;
+
+    if (!file_stat(path, &st)) {
+        ERROR("Error: Could not find source %s\n", path);
         return false;
     }
 
-    struct dirent *entry;
+    if (!st.is_dir) {
+        build_graph_watch(graph, path, INPUT_EXISTS);
 
-    while ((entry = readdir(dir))) {
-        if (entry->d_name[0] == '.') {
-            continue;
+        if (has_source_extension(path, extensions)) {
+            arena_push(&graph->arena, paths, build_add_path(graph, path));
         }
 
-        char *new_path = malloc(strlen(path) + strlen(entry->d_name) + 2);
+        return true;
+    }
 
-        if (path[strlen(path) - 1] == '/') {
-            sprintf(new_path, "%s%s", path, entry->d_name);
-        } else {
-            sprintf(new_path, "%s/%s", path, entry->d_name);
-        }
+    SourceFilter filter = {.source = source, .extensions = extensions};
 
-        if (!build_add_source(graph, new_path, paths)) {
-            free(new_path);
-            closedir(dir);
-            return false;
-        }
+    Scan scan;
+    scan_init(&scan);
+
+    if (!scan_tree(&scan, graph->scans, path, default_jobs(), is_source,
+                   &filter)) {
+        scan_free(&scan);
+        return false;
+    }
+
+    // files added to or removed from a directory change its time, so the
+    // files themselves are not watched
+    vec_foreachat(&scan.dirs, dir) build_graph_watch_dir(graph, dir);
 
-        free(new_path);
+    vec_foreach(&scan.files, file) {
+        arena_push(&graph->arena, paths,
+                   string_table_intern(&graph->strings, file));
     }
 
-    closedir(dir);
+    scan_free(&scan);
 
     return true;
 }
 
 static BuildPackage *build_add_package(BuildGraph *graph, const char *name) {
-    vec_foreach(&graph->packages, package) {
-        if (strcmp(package->name, name) == 0) {
-            return package;
-        }
+    BuildPackage **package = map_get(&graph->package_names, name);
+
+    if (package) {
+        return *package;
     }
 
-    BuildPackage *build_package = malloc(sizeof(BuildPackage));
+    BuildPackage *build_package =
+        arena_alloc(&graph->arena, sizeof(BuildPackage));
 
-    if (!build_package_init(build_package, name)) {
-        free(build_package);
+    if (!build_package_init(build_package, &graph->arena, name)) {
         return NULL;
     }
 
-    vec_push(&graph->packages, build_package);
+    arena_push(&graph->arena, &graph->packages, build_package);
+    map_put(&graph->package_names, build_package->name, build_package);
+
+    // a change to a required package changes the flags as well
+    vec_foreach(&build_package->files, file) {
+        build_graph_watch(graph, file, INPUT_MTIME);
+    }
 
     return build_package;
 }
@@ -244,12 +291,13 @@ static BuildPackage *build_add_package(BuildGraph *graph, const char *name) {
 static bool build_graph_load_target(BuildGraph *graph,
                                     BuildTarget *build_target,
                                     const Target *target) {
+    Arena *arena = &graph->arena;
 
+    // on failure, whatever was added is freed with the graph
     vec_init(&build_target->sources);
-    vec_foreach(&target->sources, source) {
-        if (!build_add_source(graph, source, &build_target->sources)) {
-            vec_free(&build_target->sources);
-
+    vec_foreachat(&target->sources, source) {
+        if (!build_add_source(graph, source, &target->extensions,
+                              &build_target->sources)) {
             return false;
         }
     }
@@ -259,28 +307,27 @@ static bool build_graph_load_target(BuildGraph *graph,
         BuildPackage *build_package = build_add_package(graph, package);
 
         if (!build_package) {
-            vec_free(&build_target->sources);
-            vec_free(&build_target->packages);
-
             return false;
         }
 
-        vec_push(&build_target->packages, build_package);
+        arena_push(arena, &build_target->packages, build_package);
     }
 
     vec_init(&build_target->includes);
     vec_foreach(&target->includes, include) {
-        vec_push(&build_target->includes, build_add_path(graph, include));
+        build_graph_watch(graph, include, INPUT_EXISTS);
+        arena_push(arena, &build_target->includes,
+                   build_add_path(graph, include));
     }
 
     vec_init(&build_target->deps);
     vec_foreach(&target->deps, dep) {
-        BuildDep *build_dep = malloc(sizeof(BuildDep));
-        build_dep_init(build_dep, dep.url, dep.target);
-        vec_push(&build_target->deps, build_dep);
+        BuildDep *build_dep = arena_alloc(arena, sizeof(BuildDep));
+        build_dep_init(build_dep, arena, dep.url, dep.target);
+        arena_push(arena, &build_target->deps, build_dep);
     }
 
-    build_target->name = strdup(target->name);
+    build_target->name = arena_strdup(arena, target->name);
     build_target->output = target->output;
     build_target->warn = target->warn;
     build_target->lang = target->lang;
@@ -289,6 +336,34 @@ static bool build_graph_load_target(BuildGraph *graph,
     return true;
 }
 
+// Add the node of a loaded build file to the graph, freeing the build.
+static BuildNode *build_graph_add_node(BuildGraph *graph, Build *build,
+                                       const char *build_path) {
+    build_graph_watch(graph, build_path, INPUT_CONTENT);
+
+    BuildNode *node = arena_alloc(&graph->arena, sizeof(BuildNode));
+    build_node_init(node);
+
+    vec_foreach(&build->targets, target) {
+        BuildTarget build_target;
+
+        if (!build_graph_load_target(graph, &build_target, target)) {
+            build_free(build);
+            build_node_free(node);
+
+            return NULL;
+        }
+
+        build_node_add_target(node, &graph->arena, build_target);
+    }
+
+    build_free(build);
+
+    arena_push(&graph->arena, &graph->nodes, node);
+
+    return node;
+}
+
 static BuildNode *build_graph_load_node(BuildGraph *graph,
                                         const char *build_path,
                                         const char *out_path) {
@@ -297,110 +372,517 @@ static BuildNode *build_graph_load_node(BuildGraph *graph,
         return NULL;
     }
 
-    BuildNode *node = malloc(sizeof(BuildNode));
-    build_node_init(node);
+    return build_graph_add_node(graph, &build, build_path);
+}
 
-    vec_foreach(&build.targets, target) {
-        BuildTarget build_target;
+// Fetch dependencies with at least this many parallel clones, since they wait
+// on the network rather than the CPU.
+#define FETCH_JOBS_MIN 4
+
+// The steps of fetching a dependency repository.
+typedef enum {
+    // Clone the repository into the shared mirror.
+    FETCH_MIRROR_CLONE,
+    // Update the existing mirror of the repository.
+    FETCH_MIRROR_UPDATE,
+    // Add a worktree of the mirror next to the checkout.
+    FETCH_WORKTREE_ADD,
+    // Move the worktree into place.
+    FETCH_WORKTREE_MOVE,
+    // Shallow clone the repository, when there is no usable mirror.
+    FETCH_SHALLOW,
+} FetchStage;
+
+// A dependency repository being resolved while a graph is loaded.
+//
+// Every dependency with the same id shares a repository, so it is only fetched
+// and loaded once.
+typedef struct {
+    const char *id;
+    const char *url;
 
-        if (!build_graph_load_target(graph, &build_target, target)) {
-            build_free(&build);
-            build_node_free(node);
-            free(node);
+    // The loaded node, or NULL if the repository is not loaded yet.
+    BuildNode *node;
 
-            return NULL;
+    // The dependencies on the repository.
+    Vec(BuildDep *) deps;
+
+    // The step the repository is fetched in, and its mirror if any.
+    FetchStage stage;
+    char mirror[512];
+
+    // Whether the build file is being loaded, rather than fetched.
+    bool loading;
+    BuildLoad load;
+    Build build;
+} DepRepo;
+
+typedef struct {
+    BuildGraph *graph;
+    JobPool pool;
+
+    Vec(DepRepo *) repos;
+    Map(DepRepo *) repo_ids;
+
+    // Repositories waiting to be fetched, and ones ready to be loaded.
+    Vec(DepRepo *) fetches;
+    size_t next_fetch;
+    Vec(DepRepo *) ready;
+    size_t next_ready;
+
+    bool failed;
+} DepLoader;
+
+static void dep_checkout_path(char *path, size_t size, const char *id) {
+    snprintf(path, size, "lute-cache/deps/%s", id);
+}
+
+static bool dep_resolve(DepRepo *repo, BuildDep *dep) {
+    dep->node = repo->node;
+    dep->target = build_node_target(repo->node, dep->name);
+
+    if (!dep->target) {
+        ERROR("Error: Dependency %s does not have target %s\n", dep->url,
+              dep->name);
+        return false;
+    }
+
+    return true;
+}
+
+// Add the dependencies of a loaded node to a loader.
+static void dep_loader_discover(DepLoader *loader, BuildNode *node) {
+    vec_foreachat(&node->targets, target) {
+        vec_foreach(&target->deps, dep) {
+            DepRepo **known = map_get(&loader->repo_ids, dep->id);
+            DepRepo *repo = known ? *known : NULL;
+
+            if (!repo) {
+                repo = malloc(sizeof(DepRepo));
+                repo->id = dep->id;
+                repo->url = dep->url;
+                repo->node = NULL;
+                repo->mirror[0] = '\0';
+                repo->loading = false;
+                vec_init(&repo->deps);
+                vec_push(&loader->repos, repo);
+                map_put(&loader->repo_ids, repo->id, repo);
+
+                char path[256];
+                dep_checkout_path(path, sizeof(path), repo->id);
+
+                if (is_dir(path)) {
+                    vec_push(&loader->ready, repo);
+                } else {
+                    vec_push(&loader->fetches, repo);
+                }
+            }
+
+            vec_push(&repo->deps, dep);
+
+            if (repo->node && !dep_resolve(repo, dep)) {
+                loader->failed = true;
+            }
         }
+    }
+}
 
-        vec_push(&node->targets, build_target);
+// Get the directory of the shared git mirrors.
+//
+// Mirrors live in `LUTE_GIT_DIR`, or `$XDG_CACHE_HOME/lute/git` which defaults
+// to `~/.cache/lute/git`. Returns false if mirrors are disabled by setting
+// `LUTE_GIT_DIR` to an empty string.
+static bool mirror_root(char *dir, size_t size) {
+    const char *env = getenv("LUTE_GIT_DIR");
+
+    if (env) {
+        snprintf(dir, size, "%s", env);
+        return *env;
     }
 
-    build_free(&build);
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
 
-    vec_push(&graph->nodes, node);
+    if (cache && *cache) {
+        snprintf(dir, size, "%s/lute/git", cache);
+    } else if (home && *home) {
+        snprintf(dir, size, "%s/.cache/lute/git", home);
+    } else {
+        return false;
+    }
 
-    return node;
+    return true;
 }
 
-static bool fetch_dep(const char *url, const char *path) {
-    Vec(const char *) args;
-    vec_init(&args);
+// Get the absolute path of a checkout, and the temporary one it is fetched to.
+static bool dep_checkout_paths(const DepRepo *repo, char *path, char *tmp,
+                               size_t size) {
+    char *cwd = get_working_dir();
+
+    if (!cwd) {
+        return false;
+    }
 
-    vec_push(&args, "git");
-    vec_push(&args, "clone");
-    vec_push(&args, url);
-    vec_push(&args, path);
+    char checkout[256];
+    dep_checkout_path(checkout, sizeof(checkout), repo->id);
 
-    char *cmd = vec_join(&args, " ");
-    vec_free(&args);
+    snprintf(path, size, "%s/%s", cwd, checkout);
+    snprintf(tmp, size, "%s/%s.tmp", cwd, checkout);
+    free(cwd);
 
-    bool success = system(cmd) == 0;
-    free(cmd);
+    stat_cache_forget(path);
+    stat_cache_forget(tmp);
+
+    return true;
+}
+
+static bool dep_loader_spawn(DepLoader *loader, DepRepo *repo, Args *args) {
+    bool success =
+        job_pool_spawn(&loader->pool, args, PROCESS_INHERIT, NULL, repo);
+    args_free(args);
 
     if (!success) {
-        ERROR("Error: Could not fetch dep %s\n", url);
+        ERROR("Error: Could not run git\n");
     }
 
     return success;
 }
 
-bool build_graph_load_deps(BuildGraph *graph, BuildNode *node) {
-    vec_foreach(&node->targets, target) {
-        vec_foreach(&target.deps, dep) {
-            // if dep is already loaded, skip
-            if (dep->node) {
-                continue;
-            }
+// Start a step of fetching a repository.
+static bool dep_loader_start(DepLoader *loader, DepRepo *repo,
+                             FetchStage stage) {
+    char path[512];
+    char tmp[512];
 
-            char path[256];
-            snprintf(path, sizeof(path), "lute-cache/deps/%s", dep->id);
+    if (!dep_checkout_paths(repo, path, tmp, sizeof(path))) {
+        return false;
+    }
 
-            // if dep is not fetched, fetch it
-            if (!is_dir(path)) {
-                if (!fetch_dep(dep->url, path)) {
-                    return false;
-                }
-            }
+    char mirror_tmp[544];
+    snprintf(mirror_tmp, sizeof(mirror_tmp), "%s.tmp%d", repo->mirror,
+             (int)getpid());
+
+    repo->stage = stage;
+
+    Args args = args_new();
+    args_push(&args, "git");
+
+    switch (stage) {
+    case FETCH_MIRROR_CLONE:
+        args_push(&args, "clone");
+        args_push(&args, "--quiet");
+        args_push(&args, "--mirror");
+        args_push(&args, "--filter=blob:none");
+        args_push(&args, repo->url);
+        args_push(&args, mirror_tmp);
+        break;
+    case FETCH_MIRROR_UPDATE:
+        args_push(&args, "-C");
+        args_push(&args, repo->mirror);
+        args_push(&args, "fetch");
+        args_push(&args, "--quiet");
+        args_push(&args, "--prune");
+        break;
+    case FETCH_WORKTREE_ADD:
+        // worktrees of removed checkouts are still registered, so force
+        // adding and moving over them
+        args_push(&args, "-C");
+        args_push(&args, repo->mirror);
+        args_push(&args, "worktree");
+        args_push(&args, "add");
+        args_push(&args, "--quiet");
+        args_push(&args, "--force");
+        args_push(&args, "--detach");
+        args_push(&args, tmp);
+        args_push(&args, "HEAD");
+        break;
+    case FETCH_WORKTREE_MOVE:
+        args_push(&args, "-C");
+        args_push(&args, repo->mirror);
+        args_push(&args, "worktree");
+        args_push(&args, "move");
+        args_push(&args, "--force");
+        args_push(&args, tmp);
+        args_push(&args, path);
+        break;
+    case FETCH_SHALLOW:
+        args_push(&args, "clone");
+        args_push(&args, "--quiet");
+        args_push(&args, "--depth");
+        args_push(&args, "1");
+        args_push(&args, repo->url);
+        args_push(&args, tmp);
+        break;
+    }
 
-            char bpath[256];
-            snprintf(bpath, sizeof(bpath), "%s/build.c", path);
+    // a checkout interrupted before it was moved into place is started over
+    if ((stage == FETCH_WORKTREE_ADD || stage == FETCH_SHALLOW) &&
+        file_exists(tmp)) {
+        remove_dir(tmp);
+    }
 
-            char opath[256];
-            snprintf(opath, sizeof(opath), "lute-cache/build/%s", dep->id);
+    return dep_loader_spawn(loader, repo, &args);
+}
 
-            // load dep node
-            BuildNode *dep_node = build_graph_load_node(graph, bpath, opath);
+// Start fetching a repository.
+//
+// Repositories are cloned once into a shared mirror without their file
+// contents, and checked out from there as worktrees. The checkout is fetched
+// into a temporary directory and moved into place once it is complete, so an
+// interrupted fetch is never mistaken for a fetched dependency.
+static bool dep_loader_fetch(DepLoader *loader, DepRepo *repo) {
+    INFO("Fetching %s\n", repo->url);
 
-            // if dep node could not be loaded, return false
-            if (!dep_node) {
-                return false;
-            }
+    char root[256];
 
-            // set dep node
-            dep->node = dep_node;
+    if (!mirror_root(root, sizeof(root)) || !make_dirs(root)) {
+        return dep_loader_start(loader, repo, FETCH_SHALLOW);
+    }
 
-            BuildTarget *dep_target = build_node_target(dep_node, dep->name);
+    snprintf(repo->mirror, sizeof(repo->mirror), "%s/%s.git", root,
+             repo->id);
 
-            // if dep target could not be found, return false
-            if (!dep_target) {
-                ERROR("Error: Dependency %s does not have target %s\n",
-                      dep->url, dep->name);
-                return false;
-            }
+    if (is_dir(repo->mirror)) {
+        return dep_loader_start(loader, repo, FETCH_MIRROR_UPDATE);
+    }
 
-            // set dep target
-            dep->target = dep_target;
+    return dep_loader_start(loader, repo, FETCH_MIRROR_CLONE);
+}
 
-            // load dep node's deps
-            if (!build_graph_load_deps(graph, dep_node)) {
-                return false;
-            }
+typedef enum {
+    FETCH_RUNNING,
+    FETCH_DONE,
+    FETCH_FAILED,
+} FetchStatus;
+
+// Continue fetching a repository after a step exited with `code`.
+static FetchStatus dep_loader_fetched(DepLoader *loader, DepRepo *repo,
+                                      int code) {
+    char path[512];
+    char tmp[512];
+
+    if (!dep_checkout_paths(repo, path, tmp, sizeof(path))) {
+        return FETCH_FAILED;
+    }
+
+    char mirror_tmp[544];
+    snprintf(mirror_tmp, sizeof(mirror_tmp), "%s.tmp%d", repo->mirror,
+             (int)getpid());
+
+    FetchStage next = FETCH_SHALLOW;
+
+    switch (repo->stage) {
+    case FETCH_MIRROR_CLONE:
+        stat_cache_forget(repo->mirror);
+
+        // another lute may have created the mirror in the meantime
+        if (code == 0 && rename(mirror_tmp, repo->mirror) != 0) {
+            remove_dir(mirror_tmp);
+        }
+
+        next = code == 0 || is_dir(repo->mirror) ? FETCH_WORKTREE_ADD
+                                                 : FETCH_SHALLOW;
+        break;
+    case FETCH_MIRROR_UPDATE:
+        // a stale mirror is still better than no checkout, eg. offline
+        if (code != 0) {
+            ERROR("Warning: Could not update mirror of %s\n", repo->url);
+        }
+
+        next = FETCH_WORKTREE_ADD;
+        break;
+    case FETCH_WORKTREE_ADD:
+        next = code == 0 ? FETCH_WORKTREE_MOVE : FETCH_SHALLOW;
+        break;
+    case FETCH_WORKTREE_MOVE:
+        if (code == 0) {
+            return FETCH_DONE;
+        }
+
+        ERROR("Error: Could not fetch dep %s\n", repo->url);
+        return FETCH_FAILED;
+    case FETCH_SHALLOW:
+        if (code == 0 && rename(tmp, path) == 0) {
+            return FETCH_DONE;
+        }
+
+        ERROR("Error: Could not fetch dep %s\n", repo->url);
+        return FETCH_FAILED;
+    }
+
+    if (!dep_loader_start(loader, repo, next)) {
+        return FETCH_FAILED;
+    }
+
+    return FETCH_RUNNING;
+}
+
+// Start loading the build file of a fetched repository.
+static LoadStatus dep_loader_load(DepLoader *loader, DepRepo *repo) {
+    char path[256];
+    dep_checkout_path(path, sizeof(path), repo->id);
+
+    char bpath[512];
+    snprintf(bpath, sizeof(bpath), "%s/build.c", path);
+
+    char opath[256];
+    snprintf(opath, sizeof(opath), "lute-cache/build/%s", repo->id);
+
+    repo->loading = true;
+
+    return build_load_start(&repo->load, &repo->build, &loader->pool, bpath,
+                            opath, repo);
+}
+
+// Add the loaded build of a repository to the graph, and resolve the
+// dependencies on it.
+static bool dep_loader_loaded(DepLoader *loader, DepRepo *repo) {
+    repo->node = build_graph_add_node(loader->graph, &repo->build,
+                                      repo->load.build_path);
+
+    build_load_free(&repo->load);
+    repo->loading = false;
+
+    if (!repo->node) {
+        return false;
+    }
+
+    vec_foreach(&repo->deps, dep) {
+        if (!dep_resolve(repo, dep)) {
+            return false;
         }
     }
 
+    dep_loader_discover(loader, repo->node);
+
     return true;
 }
 
+static bool dep_loader_handle(DepLoader *loader, LoadStatus status,
+                              DepRepo *repo) {
+    switch (status) {
+    case LOAD_RUNNING:
+        return true;
+    case LOAD_DONE:
+        return dep_loader_loaded(loader, repo);
+    case LOAD_FAILED:
+        break;
+    }
+
+    build_load_free(&repo->load);
+    repo->loading = false;
+
+    return false;
+}
+
+// Fetch and load every dependency of the root of a graph.
+//
+// Dependencies are discovered breadth first. Up to `jobs` clones, compiles of
+// build files and runs of build executables share the pool, so the build files
+// of fetched repositories are loaded while the rest are still cloning, and
+// each node is added to the graph as soon as its build file finishes.
+static bool build_graph_load_deps(BuildGraph *graph, size_t jobs) {
+    DepLoader loader = {.graph = graph, .failed = false};
+    job_pool_init(&loader.pool, jobs);
+    vec_init(&loader.repos);
+    map_init(&loader.repo_ids);
+    vec_init(&loader.fetches);
+    vec_init(&loader.ready);
+    loader.next_fetch = 0;
+    loader.next_ready = 0;
+
+    dep_loader_discover(&loader, graph->root);
+
+    while (!loader.failed) {
+        // loading comes first, as it may find more repositories to fetch
+        while (loader.next_ready < loader.ready.len &&
+               !job_pool_full(&loader.pool) && !loader.failed) {
+            DepRepo *repo = loader.ready.data[loader.next_ready++];
+            LoadStatus status = dep_loader_load(&loader, repo);
+            loader.failed = !dep_loader_handle(&loader, status, repo);
+        }
+
+        while (loader.next_fetch < loader.fetches.len &&
+               !job_pool_full(&loader.pool) && !loader.failed) {
+            DepRepo *repo = loader.fetches.data[loader.next_fetch++];
+            loader.failed = !dep_loader_fetch(&loader, repo);
+        }
+
+        if (loader.failed || loader.pool.running.len == 0) {
+            break;
+        }
+
+        void *data;
+        int code;
+
+        if (!job_pool_wait_any(&loader.pool, &data, &code)) {
+            loader.failed = true;
+            break;
+        }
+
+        DepRepo *repo = data;
+
+        if (repo->loading) {
+            LoadStatus status = build_load_continue(
+                &repo->load, &repo->build, &loader.pool, code, repo);
+            loader.failed = !dep_loader_handle(&loader, status, repo);
+            continue;
+        }
+
+        switch (dep_loader_fetched(&loader, repo, code)) {
+        case FETCH_RUNNING:
+            break;
+        case FETCH_DONE:
+            // the checkout may have been looked up before it was fetched,
+            // under its relative path as well, and all of its files are new
+            stat_cache_clear();
+            vec_push(&loader.ready, repo);
+            break;
+        case FETCH_FAILED:
+            loader.failed = true;
+            break;
+        }
+    }
+
+    // let running jobs finish, fetches are not moved into place on failure
+    while (loader.pool.running.len > 0) {
+        void *data;
+        int code;
+
+        if (!job_pool_wait_any(&loader.pool, &data, &code)) {
+            break;
+        }
+    }
+
+    vec_foreach(&loader.repos, repo) {
+        if (repo->loading) {
+            build_load_free(&repo->load);
+        }
+
+        vec_free(&repo->deps);
+        free(repo);
+    }
+
+    vec_free(&loader.repos);
+    map_free(&loader.repo_ids);
+    vec_free(&loader.fetches);
+    vec_free(&loader.ready);
+    job_pool_free(&loader.pool);
+
+    return !loader.failed;
+}
+
+size_t default_fetch_jobs() {
+    size_t jobs = default_jobs();
+
+    return jobs < FETCH_JOBS_MIN ? FETCH_JOBS_MIN : jobs;
+}
+
 bool build_graph_load(BuildGraph *graph) {
+    return build_graph_load_jobs(graph, default_fetch_jobs());
+}
+
+bool build_graph_load_jobs(BuildGraph *graph, size_t jobs) {
     if (!make_dirs("lute-out")) {
         return false;
     }
@@ -413,21 +895,35 @@ bool build_graph_load(BuildGraph *graph) {
         return false;
     }
 
-    build_graph_init(graph);
+    if (graph_snapshot_load(graph, "lute-cache/graph")) {
+        return true;
+    }
+
+    // unchanged directories are listed from the cache, rather than read
+    ScanCache scans;
+    scan_cache_load(&scans, "lute-cache/scan");
+    graph->scans = &scans;
 
     graph->root =
         build_graph_load_node(graph, "build.c", "lute-cache/build/build");
 
-    if (!graph->root) {
-        build_graph_free(graph);
-        return false;
+    bool success = graph->root && build_graph_load_deps(graph, jobs);
+
+    if (success) {
+        scan_cache_save(&scans, "lute-cache/scan");
     }
 
-    if (!build_graph_load_deps(graph, graph->root)) {
+    graph->scans = NULL;
+    scan_cache_free(&scans);
+
+    if (!success) {
         build_graph_free(graph);
         return false;
     }
 
+    // a graph without a snapshot still works, it is just loaded again
+    graph_snapshot_save(graph, "lute-cache/graph");
+
     return true;
 }
 
@@ -3,22 +3,29 @@
 
 #pragma once
 
+#include <lute/arena.h>
 #include <lute/target.h>
 #include <lute/vector.h>
 
 #include "hash.h"
+#include "intern.h"
+#include "scan.h"
+
+typedef Vec(char *) Paths;
 
 typedef struct BuildPackage {
     char *name;
     char *cflags;
     char *libs;
     char *links;
-} BuildPackage;
 
-bool build_package_init(BuildPackage *package, const char *name);
-void build_package_free(BuildPackage *package);
+    // The .pc files of the package and the packages it requires, empty if
+    // pkg-config did not report them.
+    Paths files;
+} BuildPackage;
 
-typedef Vec(char *) Paths;
+bool build_package_init(BuildPackage *package, Arena *arena,
+                        const char *name);
 
 typedef struct BuildDep BuildDep;
 typedef struct BuildTarget {
@@ -34,15 +41,19 @@ typedef struct BuildTarget {
     Vec(BuildDep *) deps;
 } BuildTarget;
 
-void build_target_free(BuildTarget *target);
-
 typedef struct BuildNode {
     Vec(BuildTarget) targets;
+
+    // The index of each target by name.
+    Map(size_t) names;
 } BuildNode;
 
 void build_node_init(BuildNode *node);
 void build_node_free(BuildNode *node);
 
+// Add a target, whose vectors are allocated from `arena`, to a node.
+void build_node_add_target(BuildNode *node, Arena *arena, BuildTarget target);
+
 BuildTarget *build_node_target(BuildNode *node, const char *name);
 
 typedef struct BuildDep {
@@ -54,24 +65,67 @@ typedef struct BuildDep {
     BuildTarget *target;
 } BuildDep;
 
-void build_dep_init(BuildDep *dep, const char *url, const char *name);
-void build_dep_free(BuildDep *dep);
+void build_dep_init(BuildDep *dep, Arena *arena, const char *url,
+                    const char *name);
+
+typedef enum {
+    // The content of a file, eg. a build script.
+    INPUT_CONTENT,
+    // The last-modified time of a file or directory.
+    INPUT_MTIME,
+    // Only that a file or directory exists.
+    INPUT_EXISTS,
+} GraphInputKind;
+
+// A file or directory the graph was loaded from.
+typedef struct {
+    char *path;
+    GraphInputKind kind;
+    int64_t mtime;
+    Hash hash;
+} GraphInput;
+
+typedef Vec(GraphInput) GraphInputs;
 
 typedef struct BuildGraph {
+    // Everything in the graph is allocated from the arena, except for the
+    // indexes by name, so it is freed at once.
+    Arena arena;
+
     Vec(BuildPackage *) packages;
     Vec(BuildDep *) deps;
     Vec(BuildNode *) nodes;
 
-    Paths paths;
+    // The paths and names of the graph, interned so every target refers to the
+    // same copy.
+    StringTable strings;
+
+    // The packages by name.
+    Map(BuildPackage *) package_names;
 
     BuildNode *root;
+
+    // Everything the graph depends on, see `snapshot.h`.
+    GraphInputs inputs;
+
+    // The directory listings of earlier loads, only set while loading.
+    ScanCache *scans;
 } BuildGraph;
 
 void build_graph_init(BuildGraph *graph);
 void build_graph_free(BuildGraph *graph);
 
+// Load the graph of the build file in the working directory.
+//
+// Missing dependencies are fetched into lute-cache/deps, several at once.
 bool build_graph_load(BuildGraph *graph);
 
+// The default number of dependencies fetched at once.
+size_t default_fetch_jobs();
+
+// Load a graph, fetching up to `jobs` dependencies at once.
+bool build_graph_load_jobs(BuildGraph *graph, size_t jobs);
+
 // This file is part of Lute.
 // Copyright (C) 2024  Hjalte C. Nannestad
 //
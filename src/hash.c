@@ -2,29 +2,229 @@
 // See end of file for license information.
 
 #include <assert.h>
+#include <fcntl.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "hash.h"
 
-void hash_string(HashId id, const char *prefix, const char *str) {
-    assert(strlen(prefix) <= 6);
+#define C1 0x87c37b91114253d5ull
+#define C2 0x4cf5ad432745937full
+
+static inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+
+    return k;
+}
+
+static inline uint64_t mix_k1(uint64_t k1) {
+    k1 *= C1;
+    k1 = rotl(k1, 31);
+    k1 *= C2;
+
+    return k1;
+}
+
+static inline uint64_t mix_k2(uint64_t k2) {
+    k2 *= C2;
+    k2 = rotl(k2, 33);
+    k2 *= C1;
+
+    return k2;
+}
+
+static void hash_blocks(HashState *state, const uint8_t *data, size_t count) {
+    uint64_t h1 = state->h1;
+    uint64_t h2 = state->h2;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t k1;
+        uint64_t k2;
+
+        // unaligned little-endian loads, compiled to plain moves on x86
+        memcpy(&k1, data + i * 16, 8);
+        memcpy(&k2, data + i * 16 + 8, 8);
+
+        h1 ^= mix_k1(k1);
+        h1 = rotl(h1, 27);
+        h1 += h2;
+        h1 = h1 * 5 + 0x52dce729;
+
+        h2 ^= mix_k2(k2);
+        h2 = rotl(h2, 31);
+        h2 += h1;
+        h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    state->h1 = h1;
+    state->h2 = h2;
+}
+
+void hash_init(HashState *state) {
+    state->h1 = 0;
+    state->h2 = 0;
+    state->len = 0;
+    state->tail_len = 0;
+}
+
+void hash_update(HashState *state, const void *data, size_t len) {
+    const uint8_t *bytes = data;
+
+    state->len += len;
+
+    if (state->tail_len > 0) {
+        size_t n = 16 - state->tail_len;
+
+        if (n > len) {
+            n = len;
+        }
+
+        memcpy(state->tail + state->tail_len, bytes, n);
+        state->tail_len += n;
+        bytes += n;
+        len -= n;
+
+        if (state->tail_len < 16) {
+            return;
+        }
+
+        hash_blocks(state, state->tail, 1);
+        state->tail_len = 0;
+    }
+
+    hash_blocks(state, bytes, len / 16);
+
+    state->tail_len = len % 16;
+    memcpy(state->tail, bytes + len - state->tail_len, state->tail_len);
+}
+
+Hash hash_final(const HashState *state) {
+    uint64_t h1 = state->h1;
+    uint64_t h2 = state->h2;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
 
-    uint64_t hash = 5381;
+    const uint8_t *tail = state->tail;
 
-    for (size_t i = 0; i < strlen(str); i++) {
-        hash = ((hash << 5) + hash) + str[i];
+    for (size_t i = state->tail_len; i > 8; i--) {
+        k2 ^= (uint64_t)tail[i - 1] << ((i - 9) * 8);
     }
 
-    id[0] = '\0';
-    strcat(id, prefix);
-    strcat(id, "-");
+    for (size_t i = state->tail_len < 8 ? state->tail_len : 8; i > 0; i--) {
+        k1 ^= (uint64_t)tail[i - 1] << ((i - 1) * 8);
+    }
+
+    if (state->tail_len > 8) {
+        h2 ^= mix_k2(k2);
+    }
+
+    if (state->tail_len > 0) {
+        h1 ^= mix_k1(k1);
+    }
+
+    h1 ^= state->len;
+    h2 ^= state->len;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = fmix(h1);
+    h2 = fmix(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+    return (Hash){.lo = h1, .hi = h2};
+}
+
+Hash hash_bytes(const void *data, size_t len) {
+    HashState state;
+    hash_init(&state);
+    hash_update(&state, data, len);
+    return hash_final(&state);
+}
+
+bool hash_file(const char *path, Hash *hash) {
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    HashState state;
+    hash_init(&state);
+
+    char buffer[65536];
+    ssize_t n;
+
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        hash_update(&state, buffer, n);
+    }
+
+    close(fd);
+
+    if (n < 0) {
+        return false;
+    }
+
+    *hash = hash_final(&state);
+
+    return true;
+}
+
+static void hex_u64(char *hex, uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < 16; i++) {
+        hex[i] = digits[(value >> ((15 - i) * 4)) & 0xf];
+    }
+}
+
+static bool parse_hex_u64(const char *hex, uint64_t *value) {
+    *value = 0;
 
     for (size_t i = 0; i < 16; i++) {
-        char c = (hash >> (i * 4)) & 0xf;
-        c = c < 10 ? '0' + c : 'a' + c - 10;
-        strncat(id, &c, 1);
+        char c = hex[i];
+
+        if (c >= '0' && c <= '9') {
+            *value = (*value << 4) | (c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            *value = (*value << 4) | (c - 'a' + 10);
+        } else {
+            return false;
+        }
     }
+
+    return true;
+}
+
+void hash_hex(HashHex hex, Hash hash) {
+    hex_u64(hex, hash.hi);
+    hex_u64(hex + 16, hash.lo);
+    hex[HASH_HEX_LEN] = '\0';
+}
+
+bool hash_parse_hex(const char *hex, Hash *hash) {
+    return parse_hex_u64(hex, &hash->hi) && parse_hex_u64(hex + 16, &hash->lo);
+}
+
+void hash_string(HashId id, const char *prefix, const char *str) {
+    assert(strlen(prefix) <= 6);
+
+    HashHex hex;
+    hash_hex(hex, hash_bytes(str, strlen(str)));
+
+    snprintf(id, sizeof(HashId), "%s-%s", prefix, hex);
 }
 
 // This file is part of Lute.
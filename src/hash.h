@@ -3,8 +3,63 @@
 
 #pragma once
 
-typedef char HashId[24];
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
+// A fast non-cryptographic 128-bit hash of some content.
+//
+// The hash is MurmurHash3 x64-128, which consumes 16 bytes per round, so
+// buffers and files are hashed at memory speed rather than byte by byte.
+typedef struct {
+    uint64_t lo;
+    uint64_t hi;
+} Hash;
+
+static inline bool hash_equal(Hash a, Hash b) {
+    return a.lo == b.lo && a.hi == b.hi;
+}
+
+// The state of a streaming hash.
+typedef struct {
+    uint64_t h1;
+    uint64_t h2;
+    uint64_t len;
+
+    // Bytes waiting for a full block.
+    uint8_t tail[16];
+    size_t tail_len;
+} HashState;
+
+void hash_init(HashState *state);
+void hash_update(HashState *state, const void *data, size_t len);
+Hash hash_final(const HashState *state);
+
+// Hash a buffer.
+Hash hash_bytes(const void *data, size_t len);
+
+// Hash the contents of a file.
+//
+// Returns false if the file could not be read.
+bool hash_file(const char *path, Hash *hash);
+
+#define HASH_HEX_LEN 32
+
+// A hash formatted as lowercase hexadecimal.
+typedef char HashHex[HASH_HEX_LEN + 1];
+
+void hash_hex(HashHex hex, Hash hash);
+
+// Parse a hash formatted by `hash_hex`.
+bool hash_parse_hex(const char *hex, Hash *hash);
+
+// An identifier of a string, eg. `dep-<hash of the url>`.
+//
+// The whole 128-bit hash is part of the identifier, so different strings do
+// not share one in practice.
+typedef char HashId[8 + HASH_HEX_LEN];
+
+// Make the identifier of a string, with a prefix of at most 6 characters.
 void hash_string(HashId id, const char *prefix, const char *str);
 
 // This file is part of Lute.
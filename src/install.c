@@ -7,6 +7,7 @@
 #include "build.h"
 #include "fs.h"
 #include "install.h"
+#include "jobs.h"
 #include "log.h"
 
 void print_install_usage() {
@@ -17,6 +18,7 @@ void print_install_usage() {
          "  -n, --dry                 "
          "Only print actions, without performing them\n"
          "      --no-build            Do not build the target\n"
+         "  -j, --jobs <n>            Run n build jobs in parallel\n"
          "      --bin-path            Set the binary installation path\n"
          "      --lib-path            Set the library installation path\n"
          "      --include-path        Set the include installation path\n"
@@ -40,6 +42,7 @@ InstallOptions install_options_default() {
     options.dry = false;
     options.build = true;
     options.nix = false;
+    options.jobs = default_jobs();
     options.bin_path = "/usr/local/bin";
     options.lib_path = "/usr/local/lib";
     options.include_path = "/usr/local/include";
@@ -60,6 +63,13 @@ bool install_options_parse(InstallOptions *options, int argc, char **argv,
             options->dry = true;
         } else if (arg_is(arg, NULL, "--no-build")) {
             options->build = false;
+        } else if (arg_is(arg, "-j", "--jobs")) {
+            char *jobs = *argi < argc ? argv[(*argi)++] : NULL;
+
+            if (!parse_jobs(jobs, &options->jobs)) {
+                ERROR("Invalid job count: %s\n", jobs ? jobs : "");
+                return false;
+            }
         } else if (arg_is(arg, NULL, "--bin-path")) {
             options->bin_path = argv[(*argi)++];
         } else if (arg_is(arg, NULL, "--lib-path")) {
@@ -159,6 +169,7 @@ int install_command(int argc, char **argv, int *argi) {
 
     BuildOptions build_options = build_options_default();
     build_options.profile = PROFILE_RELEASE;
+    build_options.jobs = options.jobs;
 
     char outdir[256];
     snprintf(outdir, sizeof(outdir), "lute-out/%s/%s",
@@ -12,6 +12,7 @@ typedef struct {
     bool dry;
     bool build;
     bool nix;
+    size_t jobs;
     const char *bin_path;
     const char *lib_path;
     const char *include_path;
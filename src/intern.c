@@ -0,0 +1,62 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+
+void string_table_init(StringTable *table, Arena *arena) {
+    map_init(&table->strings);
+    table->arena = arena;
+}
+
+void string_table_free(StringTable *table) { map_free(&table->strings); }
+
+char *string_table_intern(StringTable *table, const char *str) {
+    char **interned = map_get(&table->strings, str);
+
+    if (interned) {
+        return *interned;
+    }
+
+    char *copy = arena_strdup(table->arena, str);
+    map_put(&table->strings, copy, copy);
+
+    return copy;
+}
+
+char *string_table_adopt(StringTable *table, char *str) {
+    char **interned = map_get(&table->strings, str);
+
+    if (interned) {
+        return *interned;
+    }
+
+    map_put(&table->strings, str, str);
+
+    return str;
+}
+
+char *string_table_take(StringTable *table, char *str) {
+    char *interned = string_table_intern(table, str);
+    free(str);
+
+    return interned;
+}
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
@@ -0,0 +1,46 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#pragma once
+
+#include <lute/arena.h>
+#include <lute/vector.h>
+
+// A table of interned strings.
+//
+// Every distinct string is stored once, so interned strings can be compared by
+// pointer. The strings are copied into an arena, and outlive the table.
+typedef struct {
+    Map(char *) strings;
+    Arena *arena;
+} StringTable;
+
+void string_table_init(StringTable *table, Arena *arena);
+void string_table_free(StringTable *table);
+
+// Get the interned copy of a string, copying it into the table if needed.
+char *string_table_intern(StringTable *table, const char *str);
+
+// Like `string_table_intern`, for a string already in the arena of the table,
+// so it is not copied again.
+char *string_table_adopt(StringTable *table, char *str);
+
+// Like `string_table_intern`, but takes ownership of a heap string, which is
+// freed.
+char *string_table_take(StringTable *table, char *str);
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
@@ -0,0 +1,215 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "jobs.h"
+#include "log.h"
+
+// How often jobs are checked, in milliseconds, when some have no pidfd.
+#define JOB_POLL_INTERVAL 10
+
+static size_t ceil_div(long a, long b) { return (a + b - 1) / b; }
+
+// Get the cgroup CPU quota in whole CPUs, or 0 if there is no quota.
+static size_t cgroup_cpu_quota() {
+    long quota = -1;
+    long period = 0;
+
+    // cgroup v2 stores "<quota> <period>" where quota can be "max"
+    FILE *file = fopen("/sys/fs/cgroup/cpu.max", "r");
+
+    if (file) {
+        char buffer[32];
+
+        if (fscanf(file, "%31s %ld", buffer, &period) == 2 &&
+            strcmp(buffer, "max") != 0) {
+            quota = strtol(buffer, NULL, 10);
+        }
+
+        fclose(file);
+
+        return quota > 0 && period > 0 ? ceil_div(quota, period) : 0;
+    }
+
+    // cgroup v1 stores quota and period in separate files
+    file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r");
+
+    if (!file) {
+        return 0;
+    }
+
+    if (fscanf(file, "%ld", &quota) != 1) {
+        quota = -1;
+    }
+
+    fclose(file);
+
+    file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r");
+
+    if (!file) {
+        return 0;
+    }
+
+    if (fscanf(file, "%ld", &period) != 1) {
+        period = 0;
+    }
+
+    fclose(file);
+
+    return quota > 0 && period > 0 ? ceil_div(quota, period) : 0;
+}
+
+size_t default_jobs() {
+    size_t cpus = 0;
+
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        cpus = CPU_COUNT(&set);
+    }
+
+    if (cpus == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        cpus = online > 0 ? online : 1;
+    }
+
+    size_t quota = cgroup_cpu_quota();
+
+    if (quota && quota < cpus) {
+        cpus = quota;
+    }
+
+    return cpus;
+}
+
+bool parse_jobs(const char *arg, size_t *jobs) {
+    if (!arg) {
+        return false;
+    }
+
+    char *end;
+    unsigned long value = strtoul(arg, &end, 10);
+
+    if (*arg == '\0' || *end != '\0' || value == 0) {
+        return false;
+    }
+
+    *jobs = value;
+
+    return true;
+}
+
+void job_pool_init(JobPool *pool, size_t max) {
+    pool->max = max ? max : 1;
+    vec_init(&pool->running);
+}
+
+void job_pool_free(JobPool *pool) { vec_free(&pool->running); }
+
+bool job_pool_full(const JobPool *pool) {
+    return pool->running.len >= pool->max;
+}
+
+bool job_pool_spawn(JobPool *pool, const Args *args, ProcessFlags flags,
+                    const char *cwd, void *data) {
+    Job job;
+
+    if (!process_spawn(&job.process, args, flags, cwd)) {
+        return false;
+    }
+
+    job.pidfd = syscall(SYS_pidfd_open, job.process.pid, 0);
+    job.data = data;
+    vec_push(&pool->running, job);
+
+    return true;
+}
+
+// Remove a job that has exited from the pool.
+static void job_pool_remove(JobPool *pool, size_t index, void **data) {
+    Job job = pool->running.data[index];
+
+    if (job.pidfd >= 0) {
+        close(job.pidfd);
+    }
+
+    // the process has been reaped, this only closes the pipes
+    job.process.pid = -1;
+    process_wait(&job.process);
+
+    pool->running.data[index] = pool->running.data[--pool->running.len];
+    *data = job.data;
+}
+
+bool job_pool_wait_any(JobPool *pool, void **data, int *code) {
+    Vec(struct pollfd) fds;
+    vec_init(&fds);
+
+    while (pool->running.len > 0) {
+        for (size_t i = 0; i < pool->running.len; i++) {
+            Job *job = &pool->running.data[i];
+            int status;
+            pid_t pid = waitpid(job->process.pid, &status, WNOHANG);
+
+            if (pid == job->process.pid) {
+                *code = process_exit_code(status);
+                job_pool_remove(pool, i, data);
+                vec_free(&fds);
+                return true;
+            }
+
+            if (pid < 0 && errno != EINTR) {
+                // the process cannot be waited for, report the job as failed
+                *code = -1;
+                job_pool_remove(pool, i, data);
+                vec_free(&fds);
+                return true;
+            }
+        }
+
+        // sleep until a job exits, or poll if some cannot be waited for
+        int timeout = -1;
+        fds.len = 0;
+
+        vec_foreachat(&pool->running, job) {
+            struct pollfd fd = {.fd = job->pidfd, .events = POLLIN};
+            vec_push(&fds, fd);
+
+            if (job->pidfd < 0) {
+                timeout = JOB_POLL_INTERVAL;
+            }
+        }
+
+        poll(fds.data, fds.len, timeout);
+    }
+
+    vec_free(&fds);
+
+    return false;
+}
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
@@ -0,0 +1,70 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "process.h"
+
+// Get the default number of parallel jobs.
+//
+// This is the number of CPUs the process is allowed to run on, limited by the
+// cgroup CPU quota when running inside a container.
+size_t default_jobs();
+
+// Parse a job count from a command line argument.
+//
+// Returns false if the argument is missing or not a positive number.
+bool parse_jobs(const char *arg, size_t *jobs);
+
+typedef struct {
+    Process process;
+
+    // Readable once the process has exited, or -1 if pidfds are not
+    // supported.
+    int pidfd;
+
+    void *data;
+} Job;
+
+// A set of running processes, with at most `max` processes at once.
+typedef struct {
+    size_t max;
+    Vec(Job) running;
+} JobPool;
+
+void job_pool_init(JobPool *pool, size_t max);
+void job_pool_free(JobPool *pool);
+
+// Check if the pool has reached its maximum number of running jobs.
+bool job_pool_full(const JobPool *pool);
+
+// Spawn a job in the pool.
+//
+// The data is returned from `job_pool_wait_any` once the job finishes.
+bool job_pool_spawn(JobPool *pool, const Args *args, ProcessFlags flags,
+                    const char *cwd, void *data);
+
+// Wait for any running job to finish.
+//
+// Only the processes of the pool are reaped, so processes spawned elsewhere
+// keep their exit status. Sets the data and exit code of the finished job.
+// Returns false if no job is running.
+bool job_pool_wait_any(JobPool *pool, void **data, int *code);
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
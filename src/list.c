@@ -133,10 +133,7 @@ int list_command(int argc, char **argv, int *argi) {
 
     BuildTarget *target = NULL;
     if (argc > 2 && is_valid_target_name(argv[2])) {
-        vec_foreachat(&graph.root->targets, t) {
-            if (strcmp(t->name, argv[2]) == 0)
-                target = t;
-        }
+        target = build_node_target(graph.root, argv[2]);
 
         (*argi)++;
 
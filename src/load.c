@@ -1,11 +1,16 @@
 // Copyright (C) 2024  Hjalte C. Nannestad
 // See end of file for license information.
 
+#include <dlfcn.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "args.h"
 #include "fs.h"
+#include "hash.h"
 #include "load.h"
 #include "log.h"
 
@@ -22,10 +27,81 @@ static bool get_lute_build_flags(char **cflags, char **libs) {
     return false;
 }
 
-static bool compile_build(const char *build_path, const char *out_path) {
-    Vec(const char *) args;
-    vec_init(&args);
+// Hash everything the build executable is compiled from.
+//
+// Libraries are passed as files in LUTE_LIBS, so their time and size are part
+// of the key too, and rebuilding lute itself invalidates every executable.
+static bool build_key(const char *build_path, const char *cflags,
+                      const char *libs, bool shared, Hash *key) {
+    Hash content;
+
+    if (!hash_file(build_path, &content)) {
+        return false;
+    }
+
+    HashState state;
+    hash_init(&state);
+    hash_update(&state, VERSION, sizeof(VERSION));
+    hash_update(&state, &shared, sizeof(shared));
+    hash_update(&state, cflags, strlen(cflags) + 1);
+    hash_update(&state, libs, strlen(libs) + 1);
+    hash_update(&state, &content, sizeof(content));
+
+    Args files = args_new();
+    args_push_split(&files, libs);
+
+    vec_foreach(&files, file) {
+        FileStat st;
+
+        if (file_stat(file, &st) && !st.is_dir) {
+            hash_update(&state, &st.mtime, sizeof(st.mtime));
+            hash_update(&state, &st.size, sizeof(st.size));
+        }
+    }
+
+    args_free(&files);
+
+    *key = hash_final(&state);
+
+    return true;
+}
 
+// Check whether the build executable was compiled with a key.
+static bool build_up_to_date(const char *key_path, const char *out_path,
+                             Hash key) {
+    char *data;
+
+    if (!file_exists(out_path) || !read_file(key_path, &data)) {
+        return false;
+    }
+
+    Hash stored;
+    bool matches = hash_parse_hex(data, &stored) && hash_equal(stored, key);
+
+    free(data);
+
+    return matches;
+}
+
+static void write_build_key(const char *key_path, Hash key) {
+    FILE *file = fopen(key_path, "w");
+
+    if (!file) {
+        return;
+    }
+
+    HashHex hex;
+    hash_hex(hex, key);
+    fprintf(file, "%s\n", hex);
+    fclose(file);
+}
+
+// Prepare compiling a build file into an executable, or a shared object.
+//
+// A shared object is not linked with LUTE_LIBS, the library functions are
+// resolved against lute itself when it is loaded. `args` is left empty when
+// the output is up to date.
+static bool compile_build_args(BuildLoad *load, Args *args) {
     char *cflags;
     char *libs;
 
@@ -34,44 +110,53 @@ static bool compile_build(const char *build_path, const char *out_path) {
         return false;
     }
 
-    vec_push(&args, "clang");
-    vec_push(&args, "-o");
-    vec_push(&args, out_path);
-    vec_push(&args, cflags);
-    vec_push(&args, libs);
-    vec_push(&args, build_path);
+    // the executable is reused as long as nothing it is built from changed
+    char key_path[512];
+    snprintf(key_path, sizeof(key_path), "%s.key", load->out_path);
 
-    char *cmd = vec_join(&args, " ");
-    vec_free(&args);
-
-    if (system(cmd) != 0) {
-        ERROR("Error: Could not run clang\n");
-        ERROR("Command: %s\n", cmd);
+    load->keyed = build_key(load->build_path, cflags, libs, load->shared,
+                            &load->key);
 
+    if (load->keyed && build_up_to_date(key_path, load->out_path, load->key)) {
         free(cflags);
         free(libs);
-        free(cmd);
+        return true;
+    }
 
-        return false;
+    remove(key_path);
+
+    args_push(args, "clang");
+    args_push(args, "-o");
+    args_push(args, load->out_path);
+    args_push_split(args, cflags);
+
+    if (load->shared) {
+        args_push(args, "-shared");
+        args_push(args, "-fPIC");
+    } else {
+        args_push_split(args, libs);
     }
 
+    args_push(args, load->build_path);
+
     free(cflags);
     free(libs);
-    free(cmd);
 
     return true;
 }
 
-bool load_build(Build *build, const char *bpath, const char *opath) {
-    if (!file_exists(bpath)) {
-        ERROR("Error: Build file does not exist %s\n", bpath);
-        return false;
-    }
+static void compile_build_done(BuildLoad *load) {
+    stat_cache_forget(load->out_path);
 
-    if (!compile_build(bpath, opath)) {
-        return false;
+    if (load->keyed) {
+        char key_path[512];
+        snprintf(key_path, sizeof(key_path), "%s.key", load->out_path);
+        write_build_key(key_path, load->key);
     }
+}
 
+// Get the directory of a build file.
+static char *build_dir(const char *bpath) {
     char *bdir = strdup(bpath);
 
     if (strrchr(bdir, '/')) {
@@ -83,39 +168,235 @@ bool load_build(Build *build, const char *bpath, const char *opath) {
         bdir[1] = '\0';
     }
 
-    char *rpath = realpath(opath, NULL);
+    return bdir;
+}
 
-    Vec(const char *) args;
-    vec_init(&args);
+// Whether build files are loaded into lute with dlopen.
+static bool use_dlopen() {
+    const char *loader = getenv("LUTE_LOADER");
 
-    vec_push(&args, "cd");
-    vec_push(&args, bdir);
-    vec_push(&args, "&&");
-    vec_push(&args, rpath);
+    return loader && strcmp(loader, "dlopen") == 0;
+}
 
-    char *cmd = vec_join(&args, " ");
-    vec_free(&args);
-    free(bdir);
+// Load a build file compiled as a shared object, and call its entry point.
+static bool load_build_shared(Build *build, const char *bpath,
+                              const char *so_path) {
+    char *rpath = realpath(so_path, NULL);
+    void *handle = rpath ? dlopen(rpath, RTLD_NOW | RTLD_LOCAL) : NULL;
     free(rpath);
 
-    FILE *pipe = popen(cmd, "r");
-    free(cmd);
+    if (!handle) {
+        ERROR("Error: Could not load build %s: %s\n", so_path, dlerror());
+        return false;
+    }
 
-    if (!pipe) {
-        ERROR("Error: Could not run build\n");
+    void (*entry)(Build *);
+    *(void **)&entry = dlsym(handle, "build");
 
+    if (!entry) {
+        ERROR("Error: Build file %s does not define build\n", bpath);
+        dlclose(handle);
         return false;
     }
 
-    if (!deserialize_build(build, pipe)) {
-        ERROR("Error: Could not load build file\n");
+    // run the build function from the directory of the build file
+    char *bdir = build_dir(bpath);
+    int cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (cwd < 0 || chdir(bdir) != 0) {
+        ERROR("Error: Could not enter directory %s\n", bdir);
 
+        if (cwd >= 0) {
+            close(cwd);
+        }
+
+        free(bdir);
+        dlclose(handle);
         return false;
     }
 
-    pclose(pipe);
+    build_init(build);
+    entry(build);
 
-    return true;
+    bool success = fchdir(cwd) == 0;
+
+    close(cwd);
+    free(bdir);
+
+    // every string of the build is copied by the library, so it outlives the
+    // shared object
+    dlclose(handle);
+
+    if (!success) {
+        ERROR("Error: Could not return to the working directory\n");
+        build_free(build);
+    }
+
+    return success;
+}
+
+// Run the compiled build file.
+static LoadStatus build_load_run(BuildLoad *load, Build *build, JobPool *pool,
+                                 void *data) {
+    load->stage = LOAD_RUN;
+
+    if (load->shared) {
+        return load_build_shared(build, load->build_path, load->out_path)
+                   ? LOAD_DONE
+                   : LOAD_FAILED;
+    }
+
+    char *rpath = realpath(load->out_path, NULL);
+
+    if (!rpath) {
+        ERROR("Error: Could not find build %s\n", load->out_path);
+        return LOAD_FAILED;
+    }
+
+    // the build is written to a file rather than a pipe, so it does not need
+    // to be read while other jobs run
+    load->result_path = malloc(strlen(rpath) + sizeof(".build"));
+    sprintf(load->result_path, "%s.build", rpath);
+
+    Args args = args_new();
+    args_push(&args, rpath);
+    args_push(&args, load->result_path);
+
+    // run the build executable from the directory of the build file
+    char *bdir = build_dir(load->build_path);
+    bool success = job_pool_spawn(pool, &args, PROCESS_INHERIT, bdir, data);
+
+    args_free(&args);
+    free(bdir);
+    free(rpath);
+
+    if (!success) {
+        ERROR("Error: Could not run build\n");
+        return LOAD_FAILED;
+    }
+
+    return LOAD_RUNNING;
+}
+
+// Read the build written by a build executable.
+static bool build_load_read(BuildLoad *load, Build *build) {
+    FILE *file = fopen(load->result_path, "rb");
+
+    if (!file) {
+        return false;
+    }
+
+    bool success = deserialize_build(build, file);
+
+    fclose(file);
+    remove(load->result_path);
+
+    return success;
+}
+
+LoadStatus build_load_start(BuildLoad *load, Build *build, JobPool *pool,
+                            const char *bpath, const char *opath,
+                            void *data) {
+    load->shared = use_dlopen();
+    load->keyed = false;
+    load->result_path = NULL;
+    load->stage = LOAD_COMPILE;
+    load->build_path = strdup(bpath);
+
+    if (load->shared) {
+        load->out_path = malloc(strlen(opath) + sizeof(".so"));
+        sprintf(load->out_path, "%s.so", opath);
+    } else {
+        load->out_path = strdup(opath);
+    }
+
+    if (!file_exists(bpath)) {
+        ERROR("Error: Build file does not exist %s\n", bpath);
+        return LOAD_FAILED;
+    }
+
+    Args args = args_new();
+
+    if (!compile_build_args(load, &args)) {
+        args_free(&args);
+        return LOAD_FAILED;
+    }
+
+    if (args.len == 0) {
+        args_free(&args);
+        return build_load_run(load, build, pool, data);
+    }
+
+    if (!job_pool_spawn(pool, &args, PROCESS_INHERIT, NULL, data)) {
+        ERROR("Error: Could not run clang\n");
+        args_free(&args);
+        return LOAD_FAILED;
+    }
+
+    args_free(&args);
+
+    return LOAD_RUNNING;
+}
+
+LoadStatus build_load_continue(BuildLoad *load, Build *build, JobPool *pool,
+                               int code, void *data) {
+    switch (load->stage) {
+    case LOAD_COMPILE:
+        if (code != 0) {
+            ERROR("Error: Could not compile build file %s\n",
+                  load->build_path);
+            return LOAD_FAILED;
+        }
+
+        compile_build_done(load);
+
+        return build_load_run(load, build, pool, data);
+    case LOAD_RUN:
+        if (code != 0 || !build_load_read(load, build)) {
+            ERROR("Error: Could not load build file %s\n", load->build_path);
+            return LOAD_FAILED;
+        }
+
+        return LOAD_DONE;
+    }
+
+    return LOAD_FAILED;
+}
+
+void build_load_free(BuildLoad *load) {
+    if (load->result_path) {
+        remove(load->result_path);
+    }
+
+    free(load->build_path);
+    free(load->out_path);
+    free(load->result_path);
+}
+
+bool load_build(Build *build, const char *bpath, const char *opath) {
+    JobPool pool;
+    job_pool_init(&pool, 1);
+
+    BuildLoad load;
+    LoadStatus status =
+        build_load_start(&load, build, &pool, bpath, opath, NULL);
+
+    while (status == LOAD_RUNNING) {
+        void *data;
+        int code;
+
+        if (!job_pool_wait_any(&pool, &data, &code)) {
+            status = LOAD_FAILED;
+            break;
+        }
+
+        status = build_load_continue(&load, build, &pool, code, data);
+    }
+
+    build_load_free(&load);
+    job_pool_free(&pool);
+
+    return status == LOAD_DONE;
 }
 
 // This file is part of Lute.
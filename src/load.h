@@ -5,6 +5,63 @@
 
 #include <lute/build.h>
 
+#include "hash.h"
+#include "jobs.h"
+
+// The step a build file is loaded in.
+typedef enum {
+    // Compile the build file.
+    LOAD_COMPILE,
+    // Run the compiled build executable.
+    LOAD_RUN,
+} LoadStage;
+
+typedef enum {
+    LOAD_RUNNING,
+    LOAD_DONE,
+    LOAD_FAILED,
+} LoadStatus;
+
+// A build file being loaded with jobs of a job pool.
+//
+// Loading a build file takes up to two jobs, compiling it and running it, so
+// many build files can be loaded at the same time.
+typedef struct {
+    char *build_path;
+    char *out_path;
+
+    // Where the build executable writes the serialized build.
+    char *result_path;
+
+    bool shared;
+    bool keyed;
+    Hash key;
+
+    LoadStage stage;
+} BuildLoad;
+
+// Start loading a build file, spawning a job with `data` in `pool`.
+//
+// Returns LOAD_DONE without spawning a job, if the build could be loaded right
+// away. The pool must not be full.
+LoadStatus build_load_start(BuildLoad *load, Build *build, JobPool *pool,
+                            const char *build_path, const char *out_path,
+                            void *data);
+
+// Continue loading a build file after its job exited with `code`.
+//
+// The job is replaced by the next one, if any, so the pool does not fill up.
+LoadStatus build_load_continue(BuildLoad *load, Build *build, JobPool *pool,
+                               int code, void *data);
+
+void build_load_free(BuildLoad *load);
+
+// Load the targets of a build file.
+//
+// The build file is compiled into an executable at `out_path`, which writes
+// the serialized build. With `LUTE_LOADER=dlopen` it is compiled into a shared
+// object instead, and its `build` function is called directly in this process.
+// That is faster, but a build file that crashes or exits takes lute with it.
 bool load_build(Build *build, const char *build_path, const char *out_path);
 
 // This file is part of Lute.
@@ -9,7 +9,9 @@
 
 #include "argp.h"
 #include "build.h"
+#include "cache.h"
 #include "clean.h"
+#include "fetch.h"
 #include "init.h"
 #include "install.h"
 #include "list.h"
@@ -27,8 +29,10 @@ void print_lute_usage() {
          "  run, r            Build and run a target\n"
          "  build, b          Build a target\n"
          "  install           Install a target\n"
+         "  fetch             Fetch every dependency\n"
          "  init              Initialize a new Lute project\n"
          "  clean             Clean build artifacts\n"
+         "  cache             Manage the object cache\n"
          "  list              List available targets\n"
          "  help              Show this help message\n"
          "  version           Show version information\n");
@@ -57,10 +61,14 @@ int main(int argc, char **argv) {
             return build_command(argc, argv, &argi);
         } else if (arg_is(arg, NULL, "install")) {
             return install_command(argc, argv, &argi);
+        } else if (arg_is(arg, NULL, "fetch")) {
+            return fetch_command(argc, argv, &argi);
         } else if (arg_is(arg, NULL, "init")) {
             return init_command(argc, argv, &argi);
         } else if (arg_is(arg, NULL, "clean")) {
             return clean_command(argc, argv, &argi);
+        } else if (arg_is(arg, NULL, "cache")) {
+            return cache_command(argc, argv, &argi);
         } else if (arg_is(arg, NULL, "list")) {
             return list_command(argc, argv, &argi);
         } else if (arg_is(arg, NULL, "help") || arg_is(arg, "-h", "--help")) {
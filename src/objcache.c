@@ -0,0 +1,458 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <lute/target.h>
+
+#include "fs.h"
+#include "log.h"
+#include "objcache.h"
+
+// Manifests larger than this are started over, so they stay cheap to read.
+#define MANIFEST_MAX_SIZE (64 * 1024)
+
+void object_cache_dir(char *dir, size_t size) {
+    const char *env = getenv("LUTE_CACHE_DIR");
+
+    if (env && *env) {
+        snprintf(dir, size, "%s", env);
+    } else {
+        snprintf(dir, size, "lute-cache/objects");
+    }
+}
+
+bool object_cache_open(ObjectCache *cache) {
+    char dir[256];
+    object_cache_dir(dir, sizeof(dir));
+
+    cache->dir = strdup(dir);
+    cache->hits = 0;
+    cache->misses = 0;
+    vec_init(&cache->compilers);
+
+    char path[512];
+
+    snprintf(path, sizeof(path), "%s/manifests", dir);
+
+    if (!make_dirs(path)) {
+        ERROR("Error: Could not create object cache %s\n", dir);
+        return false;
+    }
+
+    snprintf(path, sizeof(path), "%s/objects", dir);
+
+    if (!make_dirs(path)) {
+        ERROR("Error: Could not create object cache %s\n", dir);
+        return false;
+    }
+
+    return true;
+}
+
+static void read_stats(const char *path, ObjectCacheStats *stats) {
+    FILE *file = fopen(path, "r");
+
+    if (!file) {
+        return;
+    }
+
+    if (fscanf(file, "hits %zu\nmisses %zu\n", &stats->hits,
+               &stats->misses) != 2) {
+        stats->hits = 0;
+        stats->misses = 0;
+    }
+
+    fclose(file);
+}
+
+void object_cache_close(ObjectCache *cache) {
+    if (cache->hits || cache->misses) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/stats", cache->dir);
+
+        ObjectCacheStats stats = {0};
+        read_stats(path, &stats);
+
+        char tmp[544];
+        snprintf(tmp, sizeof(tmp), "%s.tmp%d", path, (int)getpid());
+
+        FILE *file = fopen(tmp, "w");
+
+        if (file) {
+            fprintf(file, "hits %zu\nmisses %zu\n", stats.hits + cache->hits,
+                    stats.misses + cache->misses);
+
+            if (fclose(file) != 0 || rename(tmp, path) != 0) {
+                remove(tmp);
+            }
+        }
+    }
+
+    vec_foreachat(&cache->compilers, compiler) free(compiler->name);
+    vec_free(&cache->compilers);
+    free(cache->dir);
+}
+
+// Find the executable a command name refers to, like the shell would.
+static bool find_program(const char *name, char *path) {
+    if (strchr(name, '/')) {
+        return realpath(name, path) != NULL;
+    }
+
+    const char *env = getenv("PATH");
+
+    if (!env) {
+        return false;
+    }
+
+    char *dirs = strdup(env);
+    char *cursor = dirs;
+    char *dir;
+    bool found = false;
+
+    while (!found && (dir = strsep(&cursor, ":"))) {
+        char candidate[PATH_MAX];
+        snprintf(candidate, sizeof(candidate), "%s/%s", *dir ? dir : ".",
+                 name);
+
+        found = access(candidate, X_OK) == 0 && realpath(candidate, path);
+    }
+
+    free(dirs);
+
+    return found;
+}
+
+// Hash the path, time and size of the executable of a compiler.
+static bool compiler_hash(ObjectCache *cache, const char *name, Hash *hash) {
+    vec_foreachat(&cache->compilers, compiler) {
+        if (strcmp(compiler->name, name) == 0) {
+            *hash = compiler->hash;
+            return true;
+        }
+    }
+
+    char path[PATH_MAX];
+    FileStat st;
+
+    if (!find_program(name, path) || !file_stat(path, &st)) {
+        return false;
+    }
+
+    HashState state;
+    hash_init(&state);
+    hash_update(&state, path, strlen(path) + 1);
+    hash_update(&state, &st.mtime, sizeof(st.mtime));
+    hash_update(&state, &st.size, sizeof(st.size));
+
+    CompilerId compiler = {
+        .name = strdup(name),
+        .hash = hash_final(&state),
+    };
+
+    vec_push(&cache->compilers, compiler);
+    *hash = compiler.hash;
+
+    return true;
+}
+
+bool object_cache_key(ObjectCache *cache, const Args *args, const char *source,
+                      Hash *key) {
+    Hash compiler;
+    Hash content;
+
+    if (args->len == 0 || !compiler_hash(cache, args->data[0], &compiler) ||
+        !file_hash(source, &content)) {
+        return false;
+    }
+
+    HashState state;
+    hash_init(&state);
+    hash_update(&state, &compiler, sizeof(compiler));
+
+    for (size_t i = 1; i < args->len; i++) {
+        // the same object can be restored to any path
+        if (strcmp(args->data[i], "-o") == 0) {
+            i++;
+            continue;
+        }
+
+        hash_update(&state, args->data[i], strlen(args->data[i]) + 1);
+    }
+
+    hash_update(&state, &content, sizeof(content));
+
+    *key = hash_final(&state);
+
+    return true;
+}
+
+static void manifest_path(char *path, size_t size, const ObjectCache *cache,
+                          Hash key) {
+    HashHex hex;
+    hash_hex(hex, key);
+    snprintf(path, size, "%s/manifests/%s", cache->dir, hex);
+}
+
+static void object_path(char *path, size_t size, const ObjectCache *cache,
+                        Hash result) {
+    HashHex hex;
+    hash_hex(hex, result);
+    snprintf(path, size, "%s/objects/%s.o", cache->dir, hex);
+}
+
+// Check the header lines of a manifest entry against the current headers.
+//
+// A line is the hash of a header followed by a space and its path.
+static bool manifest_entry_matches(const Strings *lines) {
+    vec_foreach(lines, line) {
+        Hash expected;
+        Hash current;
+
+        if (strlen(line) < HASH_HEX_LEN + 2 || line[HASH_HEX_LEN] != ' ' ||
+            !hash_parse_hex(line, &expected) ||
+            !file_hash(line + HASH_HEX_LEN + 1, &current) ||
+            !hash_equal(current, expected)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Find the result of the first manifest entry whose headers are unchanged.
+//
+// The lines of the entry are left in `lines`, pointing into `data`.
+static bool manifest_find(char *data, Hash *result, Strings *lines) {
+    char *cursor = data;
+    char *line;
+    bool entry = false;
+
+    while ((line = strsep(&cursor, "\n"))) {
+        if (strncmp(line, "object ", 7) == 0) {
+            if (entry && manifest_entry_matches(lines)) {
+                return true;
+            }
+
+            entry = hash_parse_hex(line + 7, result);
+            lines->len = 0;
+        } else if (entry && *line) {
+            vec_push(lines, line);
+        }
+    }
+
+    return entry && manifest_entry_matches(lines);
+}
+
+bool object_cache_restore(ObjectCache *cache, Hash key, const char *object,
+                          DepsLog *log, Hash command) {
+    char path[512];
+    manifest_path(path, sizeof(path), cache, key);
+
+    char *data;
+
+    if (!read_file(path, &data)) {
+        cache->misses++;
+        return false;
+    }
+
+    Strings lines;
+    vec_init(&lines);
+
+    Hash result;
+    bool hit = manifest_find(data, &result, &lines);
+
+    if (hit) {
+        object_path(path, sizeof(path), cache, result);
+        hit = copy_file(path, object);
+    }
+
+    DepsRecord record;
+    deps_record_init(&record);
+    record.command = command;
+    record.hashed = true;
+
+    vec_foreach(&lines, line) {
+        if (!hit) {
+            break;
+        }
+
+        FileStat st;
+        DepsEntry entry = {.path = line + HASH_HEX_LEN + 1};
+
+        if (!file_stat(entry.path, &st) ||
+            !file_hash(entry.path, &entry.hash)) {
+            hit = false;
+            break;
+        }
+
+        entry.mtime = st.mtime;
+        entry.size = st.size;
+
+        vec_push(&record.deps, entry);
+    }
+
+    hit = hit && deps_log_record(log, object, &record);
+
+    if (hit) {
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+
+    deps_record_free(&record);
+    vec_free(&lines);
+    free(data);
+
+    return hit;
+}
+
+bool object_cache_store(ObjectCache *cache, Hash key, const char *object,
+                        DepsLog *log) {
+    DepsRecord record;
+    deps_record_init(&record);
+
+    if (!deps_log_get(log, object, &record)) {
+        deps_record_free(&record);
+        return false;
+    }
+
+    char *entry = NULL;
+    size_t entry_len = 0;
+    FILE *lines = open_memstream(&entry, &entry_len);
+
+    HashState state;
+    hash_init(&state);
+    hash_update(&state, &key, sizeof(key));
+
+    bool success = true;
+
+    vec_foreachat(&record.deps, dep) {
+        Hash content;
+
+        if (!file_hash(dep->path, &content)) {
+            success = false;
+            break;
+        }
+
+        hash_update(&state, dep->path, strlen(dep->path) + 1);
+        hash_update(&state, &content, sizeof(content));
+
+        HashHex hex;
+        hash_hex(hex, content);
+        fprintf(lines, "%s %s\n", hex, dep->path);
+    }
+
+    fclose(lines);
+    deps_record_free(&record);
+
+    Hash result = hash_final(&state);
+
+    char path[512];
+    object_path(path, sizeof(path), cache, result);
+
+    // identical objects are only stored once
+    success = success && (file_exists(path) || copy_file(object, path));
+
+    if (success) {
+        manifest_path(path, sizeof(path), cache, key);
+
+        FileStat st;
+        int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+
+        if (file_stat(path, &st) && st.size > MANIFEST_MAX_SIZE) {
+            flags |= O_TRUNC;
+        }
+
+        HashHex hex;
+        hash_hex(hex, result);
+
+        char header[48];
+        int header_len = snprintf(header, sizeof(header), "object %s\n", hex);
+
+        // the entry is written at once, so concurrent builds do not mix lines
+        char *data = malloc(header_len + entry_len);
+        memcpy(data, header, header_len);
+        memcpy(data + header_len, entry, entry_len);
+
+        int fd = open(path, flags, 0644);
+
+        success = fd >= 0 && write(fd, data, header_len + entry_len) ==
+                                 (ssize_t)(header_len + entry_len);
+
+        if (fd >= 0) {
+            close(fd);
+        }
+
+        stat_cache_forget(path);
+        free(data);
+    }
+
+    free(entry);
+
+    return success;
+}
+
+bool object_cache_stats(const char *dir, ObjectCacheStats *stats) {
+    stats->hits = 0;
+    stats->misses = 0;
+    stats->objects = 0;
+    stats->size = 0;
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/stats", dir);
+    read_stats(path, stats);
+
+    snprintf(path, sizeof(path), "%s/objects", dir);
+
+    DIR *objects = opendir(path);
+
+    if (!objects) {
+        return file_exists(dir);
+    }
+
+    struct dirent *entry;
+
+    while ((entry = readdir(objects))) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        char object[768];
+        snprintf(object, sizeof(object), "%s/%s", path, entry->d_name);
+
+        FileStat st;
+
+        if (file_stat(object, &st)) {
+            stats->objects++;
+            stats->size += st.size;
+        }
+    }
+
+    closedir(objects);
+
+    return true;
+}
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
@@ -0,0 +1,96 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <lute/vector.h>
+
+#include "args.h"
+#include "depslog.h"
+#include "hash.h"
+
+// The identity of a compiler, see `object_cache_key`.
+typedef struct {
+    char *name;
+    Hash hash;
+} CompilerId;
+
+// A content-addressed cache of object files.
+//
+// Objects are looked up in two steps. The key of a compile covers the
+// compiler, the command and the source, and names a manifest listing the
+// headers seen by earlier compiles with that key and their content hashes.
+// When every header of a manifest entry still has the same content, the entry
+// names the cached object.
+//
+// The cache lives in `lute-cache/objects`, or in `LUTE_CACHE_DIR` if it is set,
+// so it can be shared between projects.
+typedef struct {
+    char *dir;
+
+    // Lookups since the cache was opened.
+    size_t hits;
+    size_t misses;
+
+    Vec(CompilerId) compilers;
+} ObjectCache;
+
+// Statistics of a cache directory.
+typedef struct {
+    size_t hits;
+    size_t misses;
+    size_t objects;
+    int64_t size;
+} ObjectCacheStats;
+
+// Get the directory of the object cache.
+void object_cache_dir(char *dir, size_t size);
+
+bool object_cache_open(ObjectCache *cache);
+
+// Close a cache, adding its hits and misses to the statistics.
+void object_cache_close(ObjectCache *cache);
+
+// Compute the key of a compile.
+//
+// `args` is the compile command, where the compiler is the first argument and
+// the object follows `-o`. The object path is not part of the key.
+bool object_cache_key(ObjectCache *cache, const Args *args, const char *source,
+                      Hash *key);
+
+// Restore an object from the cache.
+//
+// On a hit the object is copied out of the cache, and its dependencies are
+// recorded in `log` with `command`. Returns false on a miss.
+bool object_cache_restore(ObjectCache *cache, Hash key, const char *object,
+                          DepsLog *log, Hash command);
+
+// Store a compiled object in the cache.
+//
+// The dependencies of the object are read from `log`, so they must be recorded
+// first.
+bool object_cache_store(ObjectCache *cache, Hash key, const char *object,
+                        DepsLog *log);
+
+// Read the statistics of a cache directory.
+bool object_cache_stats(const char *dir, ObjectCacheStats *stats);
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
@@ -0,0 +1,789 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fs.h"
+#include "pcfile.h"
+
+#if defined(__x86_64__)
+#define MULTIARCH "x86_64-linux-gnu"
+#elif defined(__aarch64__)
+#define MULTIARCH "aarch64-linux-gnu"
+#elif defined(__i386__)
+#define MULTIARCH "i386-linux-gnu"
+#endif
+
+#ifdef MULTIARCH
+#define MULTIARCH_DIR(dir, sub) dir "/" MULTIARCH sub ":"
+#else
+#define MULTIARCH_DIR(dir, sub) ""
+#endif
+
+// The search path when `PKG_CONFIG_LIBDIR` is not set.
+#ifndef PC_DEFAULT_PATH
+#define PC_DEFAULT_PATH                                                        \
+    MULTIARCH_DIR("/usr/local/lib", "/pkgconfig")                              \
+    "/usr/local/lib/pkgconfig:/usr/local/share/pkgconfig:"                     \
+    MULTIARCH_DIR("/usr/lib", "/pkgconfig")                                    \
+    "/usr/lib64/pkgconfig:/usr/lib/pkgconfig:/usr/share/pkgconfig"
+#endif
+
+// Include directories the compiler searches anyway.
+#ifndef PC_SYSTEM_INCLUDE_PATH
+#define PC_SYSTEM_INCLUDE_PATH "/usr/include"
+#endif
+
+// Library directories the linker searches anyway.
+#ifndef PC_SYSTEM_LIBRARY_PATH
+#define PC_SYSTEM_LIBRARY_PATH                                                 \
+    "/lib:" MULTIARCH_DIR("/lib", "") "/lib64:/usr/lib:"                       \
+    MULTIARCH_DIR("/usr/lib", "") "/usr/lib64"
+#endif
+
+typedef struct {
+    char *name;
+    char *value;
+} PcVar;
+
+typedef struct PcPackage PcPackage;
+typedef struct PcPackage {
+    char *name;
+    char *path;
+
+    Vec(PcVar) vars;
+
+    char *version;
+    char *cflags;
+    char *libs;
+
+    Vec(PcPackage *) requires;
+    Vec(PcPackage *) requires_private;
+
+    bool visited;
+} PcPackage;
+
+typedef struct {
+    Strings dirs;
+    const char *sysroot;
+
+    // Every package loaded, in the order they were first required.
+    Vec(PcPackage *) packages;
+} PcResolver;
+
+static void push_path_list(Strings *dirs, const char *list) {
+    char *copy = strdup(list);
+    char *cursor = copy;
+    char *dir;
+
+    while ((dir = strsep(&cursor, ":"))) {
+        if (*dir) {
+            vec_push(dirs, strdup(dir));
+        }
+    }
+
+    free(copy);
+}
+
+static const char *env_or(const char *name, const char *fallback) {
+    const char *value = getenv(name);
+
+    return value ? value : fallback;
+}
+
+static bool path_list_contains(const char *list, const char *path,
+                               size_t len) {
+    while (*list) {
+        size_t n = strcspn(list, ":");
+
+        // ignore a trailing slash on either side
+        size_t m = n > 1 && list[n - 1] == '/' ? n - 1 : n;
+        size_t l = len > 1 && path[len - 1] == '/' ? len - 1 : len;
+
+        if (m == l && memcmp(list, path, l) == 0) {
+            return true;
+        }
+
+        list += n;
+        list += *list == ':';
+    }
+
+    return false;
+}
+
+static PcPackage *pc_find(PcResolver *resolver, const char *name) {
+    vec_foreach(&resolver->packages, package) {
+        if (strcmp(package->name, name) == 0) {
+            return package;
+        }
+    }
+
+    return NULL;
+}
+
+static const char *pc_var(const PcPackage *package, const char *name,
+                          size_t len) {
+    // later definitions override earlier ones
+    for (size_t i = package->vars.len; i > 0; i--) {
+        const PcVar *var = &package->vars.data[i - 1];
+
+        if (strlen(var->name) == len && memcmp(var->name, name, len) == 0) {
+            return var->value;
+        }
+    }
+
+    return "";
+}
+
+static void pc_set_var(PcPackage *package, const char *name, char *value) {
+    PcVar var = {.name = strdup(name), .value = value};
+    vec_push(&package->vars, var);
+}
+
+// Expand the `${var}` references and `$$` escapes of a value.
+static char *pc_expand(const PcPackage *package, const char *value) {
+    char *out = NULL;
+    size_t out_len = 0;
+    FILE *stream = open_memstream(&out, &out_len);
+
+    while (*value) {
+        if (value[0] == '$' && value[1] == '$') {
+            fputc('$', stream);
+            value += 2;
+        } else if (value[0] == '$' && value[1] == '{' &&
+                   strchr(value + 2, '}')) {
+            const char *name = value + 2;
+            size_t len = strchr(name, '}') - name;
+
+            fputs(pc_var(package, name, len), stream);
+            value = name + len + 1;
+        } else {
+            fputc(*value++, stream);
+        }
+    }
+
+    fclose(stream);
+
+    return out;
+}
+
+// Join the lines continued with a backslash, and remove comments.
+static void pc_strip(char *data) {
+    char *out = data;
+
+    for (char *in = data; *in; in++) {
+        if (in[0] == '\\' && in[1] == '\n') {
+            in++;
+        } else if (in[0] == '\\' && in[1] == '#') {
+            *out++ = *++in;
+        } else if (in[0] == '#') {
+            in += strcspn(in, "\n");
+            in--;
+        } else {
+            *out++ = *in;
+        }
+    }
+
+    *out = '\0';
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+
+    size_t len = strlen(s);
+
+    while (len > 0 && isspace((unsigned char)s[len - 1])) {
+        s[--len] = '\0';
+    }
+
+    return s;
+}
+
+static bool pc_parse(PcResolver *resolver, PcPackage *package,
+                     char **requires, char **requires_private) {
+    char *data;
+
+    if (!read_file(package->path, &data)) {
+        return false;
+    }
+
+    // the directory of the .pc file, used by relocatable packages
+    char *dir = strdup(package->path);
+    *strrchr(dir, '/') = '\0';
+
+    pc_set_var(package, "pcfiledir", dir);
+    pc_set_var(package, "pc_sysrootdir",
+               strdup(resolver->sysroot ? resolver->sysroot : "/"));
+
+    pc_strip(data);
+
+    char *cursor = data;
+    char *line;
+
+    while ((line = strsep(&cursor, "\n"))) {
+        char *key = trim(line);
+        char *end = key;
+
+        while (isalnum((unsigned char)*end) || *end == '_' || *end == '.') {
+            end++;
+        }
+
+        char *op = end;
+
+        while (isspace((unsigned char)*op)) {
+            op++;
+        }
+
+        if (end == key || (*op != '=' && *op != ':')) {
+            continue;
+        }
+
+        bool is_var = *op == '=';
+        *end = '\0';
+
+        char *value = pc_expand(package, trim(op + 1));
+
+        if (is_var) {
+            pc_set_var(package, key, value);
+            continue;
+        }
+
+        char **field = NULL;
+
+        if (strcmp(key, "Version") == 0) {
+            field = &package->version;
+        } else if (strcasecmp(key, "Cflags") == 0) {
+            field = &package->cflags;
+        } else if (strcmp(key, "Libs") == 0) {
+            field = &package->libs;
+        } else if (strcmp(key, "Requires") == 0) {
+            field = requires;
+        } else if (strcmp(key, "Requires.private") == 0) {
+            field = requires_private;
+        }
+
+        if (field) {
+            free(*field);
+            *field = value;
+        } else {
+            free(value);
+        }
+    }
+
+    free(data);
+
+    return true;
+}
+
+// Compare two versions like rpm, by their numeric and alphabetic parts.
+static int pc_version_compare(const char *a, const char *b) {
+    while (*a || *b) {
+        while (*a && !isalnum((unsigned char)*a)) {
+            a++;
+        }
+
+        while (*b && !isalnum((unsigned char)*b)) {
+            b++;
+        }
+
+        if (!*a || !*b) {
+            break;
+        }
+
+        bool numeric = isdigit((unsigned char)*a);
+
+        if (numeric != (bool)isdigit((unsigned char)*b)) {
+            return numeric ? 1 : -1;
+        }
+
+        if (numeric) {
+            while (*a == '0') {
+                a++;
+            }
+
+            while (*b == '0') {
+                b++;
+            }
+        }
+
+        const char *a_end = a;
+        const char *b_end = b;
+
+        while (*a_end && (numeric ? isdigit((unsigned char)*a_end)
+                                  : isalpha((unsigned char)*a_end))) {
+            a_end++;
+        }
+
+        while (*b_end && (numeric ? isdigit((unsigned char)*b_end)
+                                  : isalpha((unsigned char)*b_end))) {
+            b_end++;
+        }
+
+        size_t a_len = a_end - a;
+        size_t b_len = b_end - b;
+
+        // a longer number is larger, without leading zeros
+        if (numeric && a_len != b_len) {
+            return a_len > b_len ? 1 : -1;
+        }
+
+        int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+
+        if (cmp != 0) {
+            return cmp > 0 ? 1 : -1;
+        }
+
+        if (a_len != b_len) {
+            return a_len > b_len ? 1 : -1;
+        }
+
+        a = a_end;
+        b = b_end;
+    }
+
+    if (!*a && !*b) {
+        return 0;
+    }
+
+    return *a ? 1 : -1;
+}
+
+static bool pc_version_satisfies(const char *version, const char *op,
+                                 const char *wanted) {
+    int cmp = pc_version_compare(version ? version : "", wanted);
+
+    if (strcmp(op, "=") == 0) {
+        return cmp == 0;
+    } else if (strcmp(op, "!=") == 0) {
+        return cmp != 0;
+    } else if (strcmp(op, "<") == 0) {
+        return cmp < 0;
+    } else if (strcmp(op, "<=") == 0) {
+        return cmp <= 0;
+    } else if (strcmp(op, ">") == 0) {
+        return cmp > 0;
+    } else if (strcmp(op, ">=") == 0) {
+        return cmp >= 0;
+    }
+
+    return false;
+}
+
+static PcPackage *pc_load(PcResolver *resolver, const char *name);
+
+// Load the packages of a `Requires` field, eg. `glib-2.0 >= 2.50, zlib`.
+static bool pc_load_requires(PcResolver *resolver, const char *field,
+                             void *requires) {
+    Vec(PcPackage *) *packages = requires;
+    const char *cursor = field ? field : "";
+
+    while (*(cursor += strspn(cursor, " \t,"))) {
+        // a name, optionally followed by an operator and a version
+        char name[256];
+        char op[3] = "";
+        char version[256] = "";
+
+        size_t len = strcspn(cursor, " \t,<>=!");
+        snprintf(name, sizeof(name), "%.*s", (int)len, cursor);
+        cursor += len;
+        cursor += strspn(cursor, " \t");
+
+        len = strspn(cursor, "<>=!");
+
+        if (len > 2 || (len == 0 && !*name)) {
+            return false;
+        }
+
+        if (len > 0) {
+            memcpy(op, cursor, len);
+            cursor += len;
+            cursor += strspn(cursor, " \t");
+
+            len = strcspn(cursor, " \t,");
+            snprintf(version, sizeof(version), "%.*s", (int)len, cursor);
+            cursor += len;
+        }
+
+        PcPackage *package = pc_load(resolver, name);
+
+        if (!package ||
+            (*op && !pc_version_satisfies(package->version, op, version))) {
+            return false;
+        }
+
+        vec_push(packages, package);
+    }
+
+    return true;
+}
+
+static PcPackage *pc_load(PcResolver *resolver, const char *name) {
+    PcPackage *package = pc_find(resolver, name);
+
+    if (package) {
+        return package;
+    }
+
+    char path[1024];
+    bool found = false;
+
+    vec_foreach(&resolver->dirs, dir) {
+        snprintf(path, sizeof(path), "%s/%s.pc", dir, name);
+
+        if (file_exists(path) && !is_dir(path)) {
+            found = true;
+            break;
+        }
+    }
+
+    if (!found) {
+        return NULL;
+    }
+
+    package = calloc(1, sizeof(PcPackage));
+    package->name = strdup(name);
+    package->path = strdup(path);
+    vec_init(&package->vars);
+    vec_init(&package->requires);
+    vec_init(&package->requires_private);
+
+    // added before its requirements, so cycles end here
+    vec_push(&resolver->packages, package);
+
+    char *requires = NULL;
+    char *requires_private = NULL;
+
+    bool success =
+        pc_parse(resolver, package, &requires, &requires_private) &&
+        pc_load_requires(resolver, requires, &package->requires) &&
+        pc_load_requires(resolver, requires_private,
+                         &package->requires_private);
+
+    free(requires);
+    free(requires_private);
+
+    return success ? package : NULL;
+}
+
+static void pc_package_free(PcPackage *package) {
+    vec_foreachat(&package->vars, var) {
+        free(var->name);
+        free(var->value);
+    }
+
+    vec_free(&package->vars);
+    vec_free(&package->requires);
+    vec_free(&package->requires_private);
+
+    free(package->name);
+    free(package->path);
+    free(package->version);
+    free(package->cflags);
+    free(package->libs);
+    free(package);
+}
+
+// Order packages so each one comes before the packages it requires.
+//
+// The packages are pushed after their requirements, so the order is reversed.
+static void pc_order(PcPackage *package, bool private, void *order) {
+    Vec(PcPackage *) *packages = order;
+
+    if (package->visited) {
+        return;
+    }
+
+    package->visited = true;
+
+    for (size_t i = package->requires.len; i > 0; i--) {
+        pc_order(package->requires.data[i - 1], private, order);
+    }
+
+    if (private) {
+        for (size_t i = package->requires_private.len; i > 0; i--) {
+            pc_order(package->requires_private.data[i - 1], private, order);
+        }
+    }
+
+    vec_push(packages, package);
+}
+
+// Split flags into arguments like a shell, removing quotes and escapes.
+static void pc_split(Strings *args, const char *flags) {
+    char *arg = malloc(strlen(flags) + 1);
+
+    while (*flags) {
+        while (isspace((unsigned char)*flags)) {
+            flags++;
+        }
+
+        if (!*flags) {
+            break;
+        }
+
+        size_t len = 0;
+        char quote = '\0';
+
+        while (*flags && (quote || !isspace((unsigned char)*flags))) {
+            if (quote && *flags == quote) {
+                quote = '\0';
+            } else if (!quote && (*flags == '"' || *flags == '\'')) {
+                quote = *flags;
+            } else if (*flags == '\\' && flags[1] && quote != '\'') {
+                arg[len++] = *++flags;
+            } else {
+                arg[len++] = *flags;
+            }
+
+            flags++;
+        }
+
+        arg[len] = '\0';
+        vec_push(args, strdup(arg));
+    }
+
+    free(arg);
+}
+
+static bool strings_contain(const Strings *strings, const char *string) {
+    vec_foreach(strings, s) {
+        if (strcmp(s, string) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Check whether an argument adds a directory the compiler searches anyway.
+static bool pc_is_system_dir(const char *arg, const char *flag,
+                             const char *list) {
+    size_t len = strlen(flag);
+
+    return strncmp(arg, flag, len) == 0 &&
+           path_list_contains(list, arg + len, strlen(arg + len));
+}
+
+// Join arguments into a line, prepending the sysroot to include and library
+// paths.
+static char *pc_join(const PcResolver *resolver, const Strings *args) {
+    const char *sysroot = resolver->sysroot;
+    size_t sysroot_len = sysroot ? strlen(sysroot) : 0;
+
+    char *out = NULL;
+    size_t out_len = 0;
+    FILE *stream = open_memstream(&out, &out_len);
+
+    for (size_t i = 0; i < args->len; i++) {
+        const char *c = args->data[i];
+
+        if (i > 0) {
+            fputc(' ', stream);
+        }
+
+        if (sysroot_len > 0 &&
+            (strncmp(c, "-I/", 3) == 0 || strncmp(c, "-L/", 3) == 0) &&
+            strncmp(c + 2, sysroot, sysroot_len) != 0) {
+            fprintf(stream, "%.2s%s", c, sysroot);
+            c += 2;
+        }
+
+        for (; *c; c++) {
+            if (isspace((unsigned char)*c) || *c == '"' || *c == '\'' ||
+                *c == '\\') {
+                fputc('\\', stream);
+            }
+
+            fputc(*c, stream);
+        }
+    }
+
+    fclose(stream);
+
+    return out;
+}
+
+// Get the number of arguments in the unit starting at `i`.
+//
+// Libraries wrapped in linker flags, eg. `-Wl,--push-state,--as-needed
+// -latomic -Wl,--pop-state`, are moved and removed as a unit.
+static size_t pc_unit_len(const Strings *args, size_t i) {
+    if (strncmp(args->data[i], "-Wl,", 4) != 0) {
+        return 1;
+    }
+
+    size_t end = i + 1;
+
+    while (end < args->len && strncmp(args->data[end], "-l", 2) == 0) {
+        end++;
+    }
+
+    if (end == i + 1) {
+        return 1;
+    }
+
+    if (end < args->len && strncmp(args->data[end], "-Wl,", 4) == 0) {
+        end++;
+    }
+
+    return end - i;
+}
+
+static bool pc_unit_equal(const Strings *args, size_t a, size_t b,
+                          size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (strcmp(args->data[a + i], args->data[b + i]) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Collect the flags of ordered packages into a line.
+//
+// The first of repeated arguments is kept, except for libraries, where the
+// last one is kept so a library comes after everything linking to it. Other
+// linker flags are kept as they are.
+static char *pc_collect(const PcResolver *resolver, void *order, bool libs) {
+    Vec(PcPackage *) *packages = order;
+
+    Strings args;
+    vec_init(&args);
+
+    for (size_t i = packages->len; i > 0; i--) {
+        PcPackage *package = packages->data[i - 1];
+        pc_split(&args, (libs ? package->libs : package->cflags) ?: "");
+    }
+
+    const char *system = libs ? env_or("PKG_CONFIG_SYSTEM_LIBRARY_PATH",
+                                       PC_SYSTEM_LIBRARY_PATH)
+                              : env_or("PKG_CONFIG_SYSTEM_INCLUDE_PATH",
+                                       PC_SYSTEM_INCLUDE_PATH);
+    bool allow_system = getenv(libs ? "PKG_CONFIG_ALLOW_SYSTEM_LIBS"
+                                    : "PKG_CONFIG_ALLOW_SYSTEM_CFLAGS");
+
+    // the system directories are not the ones in the sysroot
+    if (resolver->sysroot && *resolver->sysroot) {
+        allow_system = true;
+    }
+
+    // the kept arguments still belong to `args`
+    Strings kept;
+    vec_init(&kept);
+
+    size_t len;
+
+    for (size_t i = 0; i < args.len; i += len) {
+        char *arg = args.data[i];
+        bool keep = true;
+
+        len = pc_unit_len(&args, i);
+
+        if (!allow_system && len == 1 &&
+            pc_is_system_dir(arg, libs ? "-L" : "-I", system)) {
+            keep = false;
+        } else if (libs && (len > 1 || strncmp(arg, "-l", 2) == 0)) {
+            for (size_t j = i + 1; j + len <= args.len && keep; j++) {
+                keep = !pc_unit_equal(&args, i, j, len);
+            }
+        } else if (!libs || strncmp(arg, "-L", 2) == 0) {
+            keep = !strings_contain(&kept, arg);
+        }
+
+        for (size_t j = i; keep && j < i + len; j++) {
+            vec_push(&kept, args.data[j]);
+        }
+    }
+
+    char *line = pc_join(resolver, &kept);
+
+    vec_foreach(&args, arg) free(arg);
+    vec_free(&args);
+    vec_free(&kept);
+
+    return line;
+}
+
+bool pc_resolve(PkgConfig *config, const char *name) {
+    PcResolver resolver;
+    vec_init(&resolver.dirs);
+    vec_init(&resolver.packages);
+    resolver.sysroot = getenv("PKG_CONFIG_SYSROOT_DIR");
+
+    const char *path = getenv("PKG_CONFIG_PATH");
+
+    if (path) {
+        push_path_list(&resolver.dirs, path);
+    }
+
+    push_path_list(&resolver.dirs, env_or("PKG_CONFIG_LIBDIR", PC_DEFAULT_PATH));
+
+    PcPackage *package = pc_load(&resolver, name);
+
+    if (package) {
+        Vec(PcPackage *) order;
+        vec_init(&order);
+
+        // cflags of private requirements are needed to include their headers
+        pc_order(package, true, &order);
+        config->cflags = pc_collect(&resolver, &order, false);
+
+        vec_foreach(&resolver.packages, p) p->visited = false;
+        order.len = 0;
+
+        pc_order(package, false, &order);
+        config->libs = pc_collect(&resolver, &order, true);
+
+        Strings libs;
+        Strings links;
+        vec_init(&libs);
+        vec_init(&links);
+        pc_split(&libs, config->libs);
+
+        vec_foreach(&libs, lib) {
+            if (strncmp(lib, "-l", 2) == 0) {
+                vec_push(&links, lib);
+            }
+        }
+
+        config->links = pc_join(&resolver, &links);
+
+        vec_foreach(&libs, lib) free(lib);
+        vec_free(&libs);
+        vec_free(&links);
+        vec_free(&order);
+
+        vec_foreach(&resolver.packages, p) {
+            vec_push(&config->files, strdup(p->path));
+        }
+    }
+
+    vec_foreach(&resolver.packages, p) pc_package_free(p);
+    vec_foreach(&resolver.dirs, dir) free(dir);
+    vec_free(&resolver.packages);
+    vec_free(&resolver.dirs);
+
+    return package != NULL;
+}
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
@@ -0,0 +1,36 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "pkgconfig.h"
+
+// Resolve the flags of a package from its .pc files, without pkg-config.
+//
+// The .pc files are found on `PKG_CONFIG_PATH` followed by `PKG_CONFIG_LIBDIR`
+// or the default search path, and the packages in `Requires` are resolved
+// recursively, along with the ones in `Requires.private` for cflags. Like
+// pkg-config, flags for the system include and library directories are left
+// out, and `PKG_CONFIG_SYSROOT_DIR` is prepended to include and library paths.
+//
+// Returns false if a package is not found, or its .pc file can not be used,
+// in which case pkg-config can still be asked.
+bool pc_resolve(PkgConfig *config, const char *name);
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
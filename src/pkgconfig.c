@@ -0,0 +1,309 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "args.h"
+#include "fs.h"
+#include "hash.h"
+#include "log.h"
+#include "pcfile.h"
+#include "pkgconfig.h"
+#include "process.h"
+
+#define PKG_CONFIG_CACHE_DIR "lute-cache/pkg-config"
+
+static char *pkg_config_run(Args *args, bool report, const char *name) {
+    Process process;
+    bool success =
+        process_spawn(&process, args, PROCESS_CAPTURE_STDOUT, NULL);
+    args_free(args);
+
+    if (!success) {
+        ERROR("Error: Could not run pkg-config\n");
+        return NULL;
+    }
+
+    char *output;
+    size_t len;
+
+    if (!process_read_all(process.out, &output, &len)) {
+        ERROR("Error: Could not read pkg-config output\n");
+        process_wait(&process);
+        return NULL;
+    }
+
+    if (process_wait(&process) != 0) {
+        if (report) {
+            ERROR("Error: pkg-config failed for package %s\n", name);
+        }
+
+        free(output);
+        return NULL;
+    }
+
+    // remove trailing newline
+    while (len > 0 && (output[len - 1] == '\n' || output[len - 1] == ' ')) {
+        output[--len] = '\0';
+    }
+
+    return output;
+}
+
+static char *pkg_config_flags(const char *flag, const char *name) {
+    Args args = args_new();
+    args_push(&args, "pkg-config");
+    args_push(&args, flag);
+    args_push(&args, name);
+
+    return pkg_config_run(&args, true, name);
+}
+
+static bool strings_contain(const Strings *strings, const char *string) {
+    vec_foreach(strings, s) {
+        if (strcmp(s, string) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Find the .pc files of a package and every package it requires.
+static void pkg_config_files(PkgConfig *config, const char *name) {
+    Strings names;
+    vec_init(&names);
+    vec_push(&names, strdup(name));
+
+    // walk the requirements a level at a time, pkg-config takes many packages
+    size_t level = 0;
+
+    while (level < names.len) {
+        Args args = args_new();
+        args_push(&args, "pkg-config");
+        args_push(&args, "--print-requires");
+        args_push(&args, "--print-requires-private");
+
+        for (size_t i = level; i < names.len; i++) {
+            args_push(&args, names.data[i]);
+        }
+
+        level = names.len;
+
+        char *output = pkg_config_run(&args, false, name);
+        char *cursor = output;
+        char *line;
+
+        while (cursor && (line = strsep(&cursor, "\n"))) {
+            // a requirement may be followed by a version constraint
+            line[strcspn(line, " \t<>=!")] = '\0';
+
+            if (*line && !strings_contain(&names, line)) {
+                vec_push(&names, strdup(line));
+            }
+        }
+
+        free(output);
+    }
+
+    Args args = args_new();
+    args_push(&args, "pkg-config");
+    args_push(&args, "--path");
+    vec_foreach(&names, n) args_push(&args, n);
+
+    char *output = pkg_config_run(&args, false, name);
+    char *cursor = output;
+    char *line;
+
+    while (cursor && (line = strsep(&cursor, "\n"))) {
+        if (*line) {
+            vec_push(&config->files, strdup(line));
+        }
+    }
+
+    free(output);
+    vec_foreach(&names, n) free(n);
+    vec_free(&names);
+}
+
+// Hash the name of a package and everything else pkg-config reads.
+static void pkg_config_cache_path(char *path, size_t size, const char *name) {
+    static const char *vars[] = {
+        "PKG_CONFIG_PATH",
+        "PKG_CONFIG_LIBDIR",
+        "PKG_CONFIG_SYSROOT_DIR",
+    };
+
+    HashState state;
+    hash_init(&state);
+    hash_update(&state, name, strlen(name) + 1);
+
+    for (size_t i = 0; i < sizeof(vars) / sizeof(vars[0]); i++) {
+        const char *value = getenv(vars[i]);
+
+        // an unset variable is not the same as an empty one
+        hash_update(&state, value ? "=" : "", 1);
+
+        if (value) {
+            hash_update(&state, value, strlen(value) + 1);
+        }
+    }
+
+    HashHex hex;
+    hash_hex(hex, hash_final(&state));
+    snprintf(path, size, "%s/%s", PKG_CONFIG_CACHE_DIR, hex);
+}
+
+// Read a cached result, if every one of its .pc files is unchanged.
+//
+// Each line is a key followed by a space and its value, where a .pc file is a
+// `file` line with its time and path.
+static bool pkg_config_cache_read(PkgConfig *config, const char *path) {
+    char *data;
+
+    if (!read_file(path, &data)) {
+        return false;
+    }
+
+    char *cursor = data;
+    char *line;
+    bool valid = true;
+
+    while (valid && (line = strsep(&cursor, "\n"))) {
+        char *value = strchr(line, ' ');
+
+        if (!value) {
+            continue;
+        }
+
+        *value++ = '\0';
+
+        if (strcmp(line, "file") == 0) {
+            long long mtime;
+            int offset;
+            FileStat st;
+
+            valid = sscanf(value, "%lld %n", &mtime, &offset) == 1 &&
+                    file_stat(value + offset, &st) && st.mtime == mtime;
+
+            if (valid) {
+                vec_push(&config->files, strdup(value + offset));
+            }
+        } else if (strcmp(line, "cflags") == 0 && !config->cflags) {
+            config->cflags = strdup(value);
+        } else if (strcmp(line, "libs") == 0 && !config->libs) {
+            config->libs = strdup(value);
+        } else if (strcmp(line, "links") == 0 && !config->links) {
+            config->links = strdup(value);
+        }
+    }
+
+    free(data);
+
+    return valid && config->files.len > 0 && config->cflags && config->libs &&
+           config->links;
+}
+
+static void pkg_config_cache_write(const PkgConfig *config, const char *path) {
+    if (!make_dirs(PKG_CONFIG_CACHE_DIR)) {
+        return;
+    }
+
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp%d", path, (int)getpid());
+
+    FILE *file = fopen(tmp, "w");
+
+    if (!file) {
+        return;
+    }
+
+    vec_foreach(&config->files, pc) {
+        FileStat st;
+
+        if (file_stat(pc, &st)) {
+            fprintf(file, "file %lld %s\n", (long long)st.mtime, pc);
+        }
+    }
+
+    fprintf(file, "cflags %s\n", config->cflags);
+    fprintf(file, "libs %s\n", config->libs);
+    fprintf(file, "links %s\n", config->links);
+
+    if (fclose(file) != 0 || rename(tmp, path) != 0) {
+        remove(tmp);
+    }
+
+    stat_cache_forget(path);
+}
+
+static void pkg_config_init(PkgConfig *config) {
+    config->cflags = NULL;
+    config->libs = NULL;
+    config->links = NULL;
+    vec_init(&config->files);
+}
+
+bool pkg_config_query(PkgConfig *config, const char *name) {
+    char path[256];
+    pkg_config_cache_path(path, sizeof(path), name);
+
+    pkg_config_init(config);
+
+    if (pkg_config_cache_read(config, path)) {
+        return true;
+    }
+
+    pkg_config_free(config);
+    pkg_config_init(config);
+
+    if (pc_resolve(config, name)) {
+        pkg_config_cache_write(config, path);
+        return true;
+    }
+
+    // pkg-config may know where to find the package, or report why it can
+    // not be used
+    if (!(config->cflags = pkg_config_flags("--cflags", name)) ||
+        !(config->libs = pkg_config_flags("--libs", name)) ||
+        !(config->links = pkg_config_flags("--libs-only-l", name))) {
+        pkg_config_free(config);
+        return false;
+    }
+
+    pkg_config_files(config, name);
+
+    // without its .pc files a result could never be invalidated
+    if (config->files.len > 0) {
+        pkg_config_cache_write(config, path);
+    }
+
+    return true;
+}
+
+void pkg_config_free(PkgConfig *config) {
+    free(config->cflags);
+    free(config->libs);
+    free(config->links);
+    vec_foreach(&config->files, file) free(file);
+    vec_free(&config->files);
+}
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
@@ -0,0 +1,46 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include <lute/target.h>
+
+// The flags of a package, as reported by pkg-config.
+typedef struct {
+    char *cflags;
+    char *libs;
+    char *links;
+
+    // The .pc files the flags come from, the one of the package first.
+    Strings files;
+} PkgConfig;
+
+// Query the flags of a package.
+//
+// The .pc files of the package are read directly, see `pcfile.h`, and
+// pkg-config only runs for packages that can not be resolved that way.
+//
+// Results are cached in `lute-cache/pkg-config`, keyed by the package name and
+// the pkg-config environment variables. A cached result is used as long as
+// none of its .pc files changed.
+bool pkg_config_query(PkgConfig *config, const char *name);
+
+void pkg_config_free(PkgConfig *config);
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
@@ -0,0 +1,216 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "process.h"
+
+extern char **environ;
+
+// Open a pipe, and arrange for the write end to replace `target` in the child.
+static bool capture_fd(posix_spawn_file_actions_t *actions, int target,
+                       int *read_fd, int *write_fd) {
+    int fds[2];
+
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        return false;
+    }
+
+    *read_fd = fds[0];
+    *write_fd = fds[1];
+
+    posix_spawn_file_actions_adddup2(actions, fds[1], target);
+
+    return true;
+}
+
+bool process_spawn(Process *process, const Args *args, ProcessFlags flags,
+                   const char *cwd) {
+    process->pid = -1;
+    process->out = -1;
+    process->err = -1;
+
+    if (args->len == 0) {
+        return false;
+    }
+
+    // posix_spawn wants a null terminated argv
+    char **argv = malloc(sizeof(char *) * (args->len + 1));
+    memcpy(argv, args->data, sizeof(char *) * args->len);
+    argv[args->len] = NULL;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+
+    int out_write = -1;
+    int err_write = -1;
+    bool success = true;
+
+    if (flags & PROCESS_CAPTURE_STDOUT) {
+        success = capture_fd(&actions, STDOUT_FILENO, &process->out,
+                             &out_write);
+    }
+
+    if (success && flags & PROCESS_CAPTURE_STDERR) {
+        success = capture_fd(&actions, STDERR_FILENO, &process->err,
+                             &err_write);
+    }
+
+    if (success && cwd) {
+        success = posix_spawn_file_actions_addchdir_np(&actions, cwd) == 0;
+    }
+
+    if (success) {
+        int error = posix_spawnp(&process->pid, argv[0], &actions, NULL, argv,
+                                 environ);
+
+        if (error != 0) {
+            ERROR("Error: Could not run %s: %s\n", argv[0], strerror(error));
+            process->pid = -1;
+            success = false;
+        }
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+    free(argv);
+
+    // the write ends belong to the child now
+    if (out_write != -1)
+        close(out_write);
+    if (err_write != -1)
+        close(err_write);
+
+    if (!success) {
+        if (process->out != -1)
+            close(process->out);
+        if (process->err != -1)
+            close(process->err);
+
+        process->out = -1;
+        process->err = -1;
+    }
+
+    return success;
+}
+
+int process_exit_code(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+
+    return -1;
+}
+
+static void process_close(Process *process) {
+    if (process->out != -1)
+        close(process->out);
+    if (process->err != -1)
+        close(process->err);
+
+    process->out = -1;
+    process->err = -1;
+}
+
+bool process_try_wait(Process *process, int *status) {
+    if (process->pid < 0) {
+        return false;
+    }
+
+    pid_t pid = waitpid(process->pid, status, WNOHANG);
+
+    if (pid != process->pid) {
+        return false;
+    }
+
+    process->pid = -1;
+    process_close(process);
+
+    return true;
+}
+
+int process_wait(Process *process) {
+    int status;
+    pid_t pid;
+
+    if (process->pid < 0) {
+        process_close(process);
+        return -1;
+    }
+
+    do {
+        pid = waitpid(process->pid, &status, 0);
+    } while (pid < 0 && errno == EINTR);
+
+    process->pid = -1;
+    process_close(process);
+
+    return pid < 0 ? -1 : process_exit_code(status);
+}
+
+bool process_read_all(int fd, char **data, size_t *len) {
+    size_t cap = 4096;
+    size_t size = 0;
+    char *buffer = malloc(cap);
+
+    while (true) {
+        if (size + 1 == cap) {
+            cap *= 2;
+            buffer = realloc(buffer, cap);
+        }
+
+        ssize_t n = read(fd, buffer + size, cap - size - 1);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n < 0) {
+            free(buffer);
+            return false;
+        }
+
+        if (n == 0) {
+            break;
+        }
+
+        size += n;
+    }
+
+    buffer[size] = '\0';
+    *data = buffer;
+
+    if (len) {
+        *len = size;
+    }
+
+    return true;
+}
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
@@ -0,0 +1,74 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "args.h"
+
+typedef enum {
+    // Inherit stdout and stderr from lute.
+    PROCESS_INHERIT = 0,
+
+    // Capture stdout through a pipe, see `Process.out`.
+    PROCESS_CAPTURE_STDOUT = 1 << 0,
+
+    // Capture stderr through a pipe, see `Process.err`.
+    PROCESS_CAPTURE_STDERR = 1 << 1,
+} ProcessFlags;
+
+// A running child process.
+typedef struct {
+    pid_t pid;
+
+    // The read end of the stdout pipe, or -1 if stdout is not captured.
+    int out;
+
+    // The read end of the stderr pipe, or -1 if stderr is not captured.
+    int err;
+} Process;
+
+// Spawn a process directly from an argument vector, without a shell.
+//
+// The first argument is looked up in PATH. If `cwd` is not NULL the process is
+// started in that directory.
+bool process_spawn(Process *process, const Args *args, ProcessFlags flags,
+                   const char *cwd);
+
+// Check if a process has exited without blocking.
+//
+// Returns true and sets `status` if the process has exited.
+bool process_try_wait(Process *process, int *status);
+
+// Wait for a process to exit and close its pipes.
+//
+// Returns the exit code of the process, 128 + signal if it was killed by a
+// signal or -1 if waiting failed.
+int process_wait(Process *process);
+
+// Convert a raw wait status to an exit code like `process_wait`.
+int process_exit_code(int status);
+
+// Read a file descriptor until end of file.
+//
+// The data is null terminated, `len` may be NULL.
+bool process_read_all(int fd, char **data, size_t *len);
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
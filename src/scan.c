@@ -0,0 +1,578 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fs.h"
+#include "log.h"
+#include "scan.h"
+
+// Scan with at most this many threads, beyond that the file system is the
+// bottleneck.
+#define SCAN_JOBS_MAX 8
+
+// Directories changed less than this long before a scan are not cached, as a
+// change right after reading them may not change their time.
+#define SCAN_CACHE_SLACK 1000000000
+
+// A directory to read, by its real path and its path relative to the root.
+typedef struct {
+    char *path;
+    char *rel;
+} ScanItem;
+
+typedef struct {
+    ScanFilter filter;
+    void *data;
+
+    ScanCache *cache;
+
+    // Listings of directories changed after this are not cached.
+    int64_t stable;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    // Every directory queued so far, the ones from `next` on are not read yet.
+    Vec(ScanItem) queue;
+    size_t next;
+
+    // The number of directories queued or being read.
+    size_t active;
+
+    bool failed;
+
+    Scan *scan;
+} Scanner;
+
+// What reading a single directory found.
+typedef struct {
+    Strings files;
+    Vec(ScanItem) dirs;
+} ScanBatch;
+
+void scan_init(Scan *scan) {
+    vec_init(&scan->files);
+    vec_init(&scan->dirs);
+}
+
+void scan_free(Scan *scan) {
+    vec_foreach(&scan->files, file) free(file);
+    vec_foreachat(&scan->dirs, dir) free(dir->path);
+
+    vec_free(&scan->files);
+    vec_free(&scan->dirs);
+}
+
+static ScanListing *scan_listing_new(const char *path, int64_t mtime) {
+    ScanListing *listing = malloc(sizeof(ScanListing));
+    listing->path = strdup(path);
+    listing->mtime = mtime;
+    listing->seen = false;
+    vec_init(&listing->entries);
+
+    return listing;
+}
+
+static void scan_listing_free(ScanListing *listing) {
+    vec_foreachat(&listing->entries, entry) free(entry->name);
+    vec_free(&listing->entries);
+    free(listing->path);
+    free(listing);
+}
+
+void scan_cache_init(ScanCache *cache) {
+    map_init(&cache->listings);
+    vec_init(&cache->retired);
+}
+
+void scan_cache_free(ScanCache *cache) {
+    map_foreach(&cache->listings, entry) scan_listing_free(entry->value);
+    vec_foreach(&cache->retired, listing) scan_listing_free(listing);
+
+    map_free(&cache->listings);
+    vec_free(&cache->retired);
+}
+
+// Make a listing the current one of its directory.
+static void scan_cache_put(ScanCache *cache, ScanListing *listing) {
+    ScanListing **current = map_get(&cache->listings, listing->path);
+
+    if (current) {
+        vec_push(&cache->retired, *current);
+        *current = listing;
+    } else {
+        map_put(&cache->listings, listing->path, listing);
+    }
+}
+
+static unsigned char scan_type(char kind) {
+    switch (kind) {
+    case 'd':
+        return DT_DIR;
+    case 'l':
+        return DT_LNK;
+    case 'f':
+        return DT_REG;
+    default:
+        return DT_UNKNOWN;
+    }
+}
+
+static char scan_kind(unsigned char type) {
+    return type == DT_DIR ? 'd' : type == DT_LNK ? 'l' : 'f';
+}
+
+// Parse the lines of a cache, a `dir <mtime> <path>` line followed by a
+// `<kind> <name>` line for each entry.
+static bool scan_cache_parse(ScanCache *cache, char *data) {
+    ScanListing *listing = NULL;
+    char *line;
+
+    while ((line = strsep(&data, "\n"))) {
+        if (!*line) {
+            continue;
+        }
+
+        long long mtime;
+        int offset;
+
+        if (strncmp(line, "dir ", 4) == 0) {
+            if (sscanf(line + 4, "%lld %n", &mtime, &offset) != 1) {
+                return false;
+            }
+
+            listing = scan_listing_new(line + 4 + offset, mtime);
+            scan_cache_put(cache, listing);
+            continue;
+        }
+
+        if (!listing || line[1] != ' ' || !line[2] ||
+            scan_type(line[0]) == DT_UNKNOWN) {
+            return false;
+        }
+
+        ScanEntry entry = {.name = strdup(line + 2), .type = scan_type(*line)};
+        vec_push(&listing->entries, entry);
+    }
+
+    return true;
+}
+
+void scan_cache_load(ScanCache *cache, const char *path) {
+    scan_cache_init(cache);
+
+    char *data;
+
+    if (!file_exists(path) || !read_file(path, &data)) {
+        return;
+    }
+
+    if (!scan_cache_parse(cache, data)) {
+        // a listing may be missing entries, so none of them are used
+        scan_cache_free(cache);
+        scan_cache_init(cache);
+    }
+
+    free(data);
+}
+
+static void scan_cache_write(FILE *file, const ScanListing *listing) {
+    fprintf(file, "dir %lld %s\n", (long long)listing->mtime, listing->path);
+
+    vec_foreachat(&listing->entries, entry) {
+        fprintf(file, "%c %s\n", scan_kind(entry->type), entry->name);
+    }
+}
+
+void scan_cache_save(const ScanCache *cache, const char *path) {
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp%d", path, (int)getpid());
+
+    FILE *file = fopen(tmp, "w");
+
+    if (!file) {
+        return;
+    }
+
+    // listings that were not used are of directories no longer scanned
+    map_foreach(&cache->listings, entry) {
+        if (entry->value->seen) {
+            scan_cache_write(file, entry->value);
+        }
+    }
+
+    if (fclose(file) != 0 || rename(tmp, path) != 0) {
+        remove(tmp);
+    }
+
+    stat_cache_forget(path);
+}
+
+static char *scan_join(const char *dir, const char *name) {
+    size_t len = strlen(dir);
+    char *path = malloc(len + strlen(name) + 2);
+
+    // only the root directory ends with a slash
+    sprintf(path, len > 0 && dir[len - 1] == '/' ? "%s%s" : "%s/%s", dir, name);
+
+    return path;
+}
+
+// Whether `dir` is `path` or one of its parents.
+static bool scan_is_parent(const char *dir, const char *path) {
+    size_t len = strlen(dir);
+
+    return strncmp(dir, path, len) == 0 &&
+           (path[len] == '\0' || path[len] == '/' || dir[len - 1] == '/');
+}
+
+// Stop the scan, reporting only the first error.
+static void scan_fail(Scanner *scanner, const char *message, const char *path) {
+    pthread_mutex_lock(&scanner->lock);
+
+    if (!scanner->failed) {
+        ERROR("Error: %s %s\n", message, path);
+        scanner->failed = true;
+    }
+
+    pthread_cond_broadcast(&scanner->cond);
+    pthread_mutex_unlock(&scanner->lock);
+}
+
+// List the entries of a directory.
+//
+// Returns false if it cannot be read, and clears `cacheable` if the listing
+// cannot be saved.
+static bool scan_list(Scanner *scanner, ScanListing *listing,
+                      bool *cacheable) {
+    int fd = open(listing->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *dir = fd >= 0 ? fdopendir(fd) : NULL;
+
+    if (!dir) {
+        scan_fail(scanner, "Could not open directory", listing->path);
+
+        if (fd >= 0) {
+            close(fd);
+        }
+
+        return false;
+    }
+
+    struct dirent *entry;
+    bool success = true;
+
+    while (success && (entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        unsigned char type = entry->d_type;
+
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+
+            if (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                char *path = scan_join(listing->path, entry->d_name);
+                scan_fail(scanner, "Could not find source", path);
+                free(path);
+
+                success = false;
+                break;
+            }
+
+            type = S_ISDIR(st.st_mode)   ? DT_DIR
+                   : S_ISLNK(st.st_mode) ? DT_LNK
+                                         : DT_REG;
+        } else if (type != DT_DIR && type != DT_LNK) {
+            type = DT_REG;
+        }
+
+        // the cache is line based
+        if (strchr(entry->d_name, '\n')) {
+            *cacheable = false;
+        }
+
+        ScanEntry scan_entry = {.name = strdup(entry->d_name), .type = type};
+        vec_push(&listing->entries, scan_entry);
+    }
+
+    closedir(dir);
+
+    return success;
+}
+
+// Sort an entry of a directory into the files or directories of a batch.
+//
+// Symbolic links are resolved, so the collected paths stay real paths.
+static bool scan_entry(Scanner *scanner, ScanBatch *batch, const ScanItem *dir,
+                       const ScanEntry *entry) {
+    char *path = scan_join(dir->path, entry->name);
+    unsigned char type = entry->type;
+
+    if (type == DT_LNK) {
+        char *real = realpath(path, NULL);
+        struct stat st;
+
+        if (!real || stat(real, &st) != 0) {
+            scan_fail(scanner, "Could not find source", path);
+            free(real);
+            free(path);
+            return false;
+        }
+
+        free(path);
+        path = real;
+
+        // a link back up the tree would be scanned forever
+        if (S_ISDIR(st.st_mode) && scan_is_parent(path, dir->path)) {
+            free(path);
+            return true;
+        }
+
+        type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+    }
+
+    char *rel = *dir->rel ? scan_join(dir->rel, entry->name)
+                          : strdup(entry->name);
+
+    if (!scanner->filter(rel, type == DT_DIR, scanner->data)) {
+        free(rel);
+        free(path);
+    } else if (type == DT_DIR) {
+        ScanItem item = {.path = path, .rel = rel};
+        vec_push(&batch->dirs, item);
+    } else {
+        free(rel);
+        vec_push(&batch->files, path);
+    }
+
+    return true;
+}
+
+// Read a directory, and add what it holds to the scan.
+//
+// A directory with a cached listing as of its current time is not read.
+static void scan_read(Scanner *scanner, ScanItem item) {
+    char *path = item.path;
+    struct stat st;
+
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        scan_fail(scanner, "Could not open directory", path);
+        free(item.rel);
+        free(path);
+        return;
+    }
+
+    int64_t mtime =
+        (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+
+    ScanListing *listing = NULL;
+
+    // listings are not changed once cached, so they are only looked up under
+    // the lock
+    if (scanner->cache) {
+        pthread_mutex_lock(&scanner->lock);
+
+        ScanListing **cached = map_get(&scanner->cache->listings, path);
+
+        if (cached && (*cached)->mtime == mtime) {
+            listing = *cached;
+        }
+
+        pthread_mutex_unlock(&scanner->lock);
+    }
+
+    bool fresh = !listing;
+    bool cacheable = scanner->cache && mtime < scanner->stable;
+
+    if (fresh) {
+        listing = scan_listing_new(path, mtime);
+
+        if (!scan_list(scanner, listing, &cacheable)) {
+            scan_listing_free(listing);
+            free(item.rel);
+            free(path);
+            return;
+        }
+    }
+
+    ScanBatch batch;
+    vec_init(&batch.files);
+    vec_init(&batch.dirs);
+
+    bool success = true;
+
+    vec_foreachat(&listing->entries, entry) {
+        if (success) {
+            success = scan_entry(scanner, &batch, &item, entry);
+        }
+    }
+
+    ScanDir scan_dir = {.path = path, .mtime = mtime};
+
+    pthread_mutex_lock(&scanner->lock);
+
+    vec_push(&scanner->scan->dirs, scan_dir);
+    vec_extend(&scanner->scan->files, &batch.files);
+    vec_extend(&scanner->queue, &batch.dirs);
+    scanner->active += batch.dirs.len;
+
+    if (!fresh || cacheable) {
+        listing->seen = true;
+    }
+
+    if (fresh && cacheable) {
+        scan_cache_put(scanner->cache, listing);
+        listing = NULL;
+    }
+
+    pthread_cond_broadcast(&scanner->cond);
+    pthread_mutex_unlock(&scanner->lock);
+
+    if (fresh && listing) {
+        scan_listing_free(listing);
+    }
+
+    vec_free(&batch.files);
+    vec_free(&batch.dirs);
+    free(item.rel);
+}
+
+// Read queued directories until every one is read, or the scan fails.
+static void *scan_worker(void *arg) {
+    Scanner *scanner = arg;
+
+    pthread_mutex_lock(&scanner->lock);
+
+    while (!scanner->failed && scanner->active > 0) {
+        if (scanner->next == scanner->queue.len) {
+            pthread_cond_wait(&scanner->cond, &scanner->lock);
+            continue;
+        }
+
+        ScanItem item = scanner->queue.data[scanner->next++];
+
+        pthread_mutex_unlock(&scanner->lock);
+        scan_read(scanner, item);
+        pthread_mutex_lock(&scanner->lock);
+
+        if (--scanner->active == 0) {
+            pthread_cond_broadcast(&scanner->cond);
+        }
+    }
+
+    pthread_mutex_unlock(&scanner->lock);
+
+    return NULL;
+}
+
+static int scan_compare_files(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int scan_compare_dirs(const void *a, const void *b) {
+    return strcmp(((const ScanDir *)a)->path, ((const ScanDir *)b)->path);
+}
+
+bool scan_tree(Scan *scan, ScanCache *cache, const char *root, size_t jobs,
+               ScanFilter filter, void *data) {
+    char *path = realpath(root, NULL);
+
+    if (!path) {
+        ERROR("Error: Could not find source %s\n", root);
+        return false;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    Scanner scanner = {
+        .filter = filter,
+        .data = data,
+        .cache = cache,
+        .stable = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec -
+                  SCAN_CACHE_SLACK,
+        .next = 0,
+        .active = 1,
+        .failed = false,
+        .scan = scan,
+    };
+
+    pthread_mutex_init(&scanner.lock, NULL);
+    pthread_cond_init(&scanner.cond, NULL);
+    vec_init(&scanner.queue);
+
+    // the root is read first, so a tree without subdirectories starts no
+    // threads
+    ScanItem item = {.path = path, .rel = strdup("")};
+
+    scan_read(&scanner, item);
+    scanner.active--;
+
+    // a deep tree can start from a single subdirectory, so workers without a
+    // directory to read wait for the others to queue more
+    size_t threads = jobs > SCAN_JOBS_MAX ? SCAN_JOBS_MAX : jobs;
+
+    if (scanner.queue.len == 0) {
+        threads = 1;
+    }
+
+    Vec(pthread_t) workers;
+    vec_init(&workers);
+
+    // the calling thread is one of the workers
+    for (size_t i = 1; i < threads; i++) {
+        pthread_t worker;
+
+        if (pthread_create(&worker, NULL, scan_worker, &scanner) == 0) {
+            vec_push(&workers, worker);
+        }
+    }
+
+    scan_worker(&scanner);
+
+    vec_foreach(&workers, worker) pthread_join(worker, NULL);
+    vec_free(&workers);
+
+    // directories left unread after a failure
+    for (size_t i = scanner.next; i < scanner.queue.len; i++) {
+        free(scanner.queue.data[i].path);
+        free(scanner.queue.data[i].rel);
+    }
+
+    vec_free(&scanner.queue);
+    pthread_mutex_destroy(&scanner.lock);
+    pthread_cond_destroy(&scanner.cond);
+
+    qsort(scan->files.data, scan->files.len, sizeof(char *),
+          scan_compare_files);
+    qsort(scan->dirs.data, scan->dirs.len, sizeof(ScanDir), scan_compare_dirs);
+
+    return !scanner.failed;
+}
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
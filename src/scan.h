@@ -0,0 +1,102 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <lute/target.h>
+#include <lute/vector.h>
+
+// Decide whether a file or directory found by a scan is kept.
+//
+// `path` is relative to the root, through symbolic links by their names rather
+// than their targets. Directories that are not kept are not read. Called from
+// the scanning threads, so it must not touch shared state.
+typedef bool (*ScanFilter)(const char *path, bool is_dir, void *data);
+
+typedef struct {
+    char *path;
+
+    // The last-modified time in nanoseconds.
+    int64_t mtime;
+} ScanDir;
+
+// An entry of a directory listing.
+typedef struct {
+    char *name;
+
+    // `DT_DIR`, `DT_LNK` or `DT_REG` for anything else.
+    unsigned char type;
+} ScanEntry;
+
+// The entries of a directory, as of its last-modified time.
+typedef struct {
+    char *path;
+    int64_t mtime;
+    Vec(ScanEntry) entries;
+
+    // Whether the listing was used by a scan, so it is saved again.
+    bool seen;
+} ScanListing;
+
+// Directory listings remembered between runs.
+//
+// A directory whose time is unchanged is not read again, only the directories
+// in it are checked. Symbolic links are resolved again every time, since
+// their targets can change without the directory changing.
+typedef struct {
+    // The current listing of each directory, by path.
+    Map(ScanListing *) listings;
+
+    // Listings that were replaced. They are kept until the cache is freed, as
+    // their paths are keys of `listings` and they may still be in use.
+    Vec(ScanListing *) retired;
+} ScanCache;
+
+void scan_cache_init(ScanCache *cache);
+void scan_cache_free(ScanCache *cache);
+
+// Load a cache, starting over if it is missing or malformed.
+void scan_cache_load(ScanCache *cache, const char *path);
+
+// Save the listings used since the cache was loaded.
+void scan_cache_save(const ScanCache *cache, const char *path);
+
+// The result of scanning a directory tree.
+typedef struct {
+    // The collected files, sorted.
+    Strings files;
+
+    // Every directory of the tree, including the root, sorted.
+    Vec(ScanDir) dirs;
+} Scan;
+
+void scan_init(Scan *scan);
+void scan_free(Scan *scan);
+
+// Scan a directory tree for files, on up to `jobs` threads.
+//
+// Directories are read with their entry types, so files are only stat'ed when
+// the type is unknown or they are symbolic links. Paths are made from the real
+// path of the root, rather than resolved one by one. `cache` may be NULL.
+bool scan_tree(Scan *scan, ScanCache *cache, const char *root, size_t jobs,
+               ScanFilter filter, void *data);
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
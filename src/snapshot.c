@@ -0,0 +1,507 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fs.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC "LUTEGRPH"
+#define SNAPSHOT_VERSION 3
+
+// A string that is NULL.
+#define NULL_STRING UINT32_MAX
+
+// header:  char magic[8], u32 version, u32 pad, hash environment
+// inputs:  u32 count, input[count]
+// input:   u32 kind, string path, i64 mtime, hash
+// package: string name, string cflags, string libs, string links,
+//          u32 count, string files[count]
+// nodes:   u32 count, u32 root, node[count]
+// node:    u32 count, target[count]
+// target:  string name, u32 output, u32 warn, u32 lang, u32 std,
+//          u32 count, string sources[count], u32 count, string includes[count],
+//          u32 count, u32 packages[count], u32 count, dep[count]
+// dep:     string url, string name, u32 node, u32 target
+// string:  u32 len, char data[len]
+
+// The environment variables that change how a graph is loaded.
+static const char *SNAPSHOT_ENV[] = {
+    "LUTE_CFLAGS",
+    "LUTE_LIBS",
+    "PKG_CONFIG_PATH",
+    "PKG_CONFIG_LIBDIR",
+    "PKG_CONFIG_SYSROOT_DIR",
+};
+
+static Hash environment_hash() {
+    HashState state;
+    hash_init(&state);
+    hash_update(&state, VERSION, sizeof(VERSION));
+
+    for (size_t i = 0; i < sizeof(SNAPSHOT_ENV) / sizeof(SNAPSHOT_ENV[0]);
+         i++) {
+        const char *value = getenv(SNAPSHOT_ENV[i]);
+
+        hash_update(&state, SNAPSHOT_ENV[i], strlen(SNAPSHOT_ENV[i]) + 1);
+
+        if (value) {
+            hash_update(&state, "=", 1);
+            hash_update(&state, value, strlen(value) + 1);
+        }
+    }
+
+    return hash_final(&state);
+}
+
+typedef struct {
+    const char *data;
+    size_t size;
+    size_t pos;
+
+    // Cleared when reading past the end.
+    bool ok;
+
+    // Where strings are read to.
+    Arena *arena;
+} Reader;
+
+static void read_bytes(Reader *reader, void *out, size_t len) {
+    if (!reader->ok || reader->size - reader->pos < len) {
+        reader->ok = false;
+        memset(out, 0, len);
+        return;
+    }
+
+    memcpy(out, reader->data + reader->pos, len);
+    reader->pos += len;
+}
+
+static uint32_t read_u32(Reader *reader) {
+    uint32_t value;
+    read_bytes(reader, &value, sizeof(value));
+    return value;
+}
+
+static int64_t read_i64(Reader *reader) {
+    int64_t value;
+    read_bytes(reader, &value, sizeof(value));
+    return value;
+}
+
+static Hash read_hash(Reader *reader) {
+    Hash value;
+    read_bytes(reader, &value, sizeof(value));
+    return value;
+}
+
+static char *read_string(Reader *reader) {
+    uint32_t len = read_u32(reader);
+
+    if (!reader->ok || len == NULL_STRING) {
+        return NULL;
+    }
+
+    if (reader->size - reader->pos < len) {
+        reader->ok = false;
+        return NULL;
+    }
+
+    char *str = arena_alloc(reader->arena, len + 1);
+    memcpy(str, reader->data + reader->pos, len);
+    str[len] = '\0';
+    reader->pos += len;
+
+    return str;
+}
+
+static void write_u32(FILE *file, uint32_t value) {
+    fwrite(&value, sizeof(value), 1, file);
+}
+
+static void write_i64(FILE *file, int64_t value) {
+    fwrite(&value, sizeof(value), 1, file);
+}
+
+static void write_hash(FILE *file, Hash value) {
+    fwrite(&value, sizeof(value), 1, file);
+}
+
+static void write_string(FILE *file, const char *str) {
+    if (!str) {
+        write_u32(file, NULL_STRING);
+        return;
+    }
+
+    write_u32(file, strlen(str));
+    fwrite(str, 1, strlen(str), file);
+}
+
+// Check whether an input is the same as when it was recorded.
+static bool input_unchanged(const GraphInput *input) {
+    FileStat st;
+
+    if (!file_stat(input->path, &st)) {
+        return false;
+    }
+
+    Hash hash;
+
+    switch (input->kind) {
+    case INPUT_CONTENT:
+        return file_hash(input->path, &hash) && hash_equal(hash, input->hash);
+    case INPUT_MTIME:
+        return st.mtime == input->mtime;
+    case INPUT_EXISTS:
+        return true;
+    }
+
+    return false;
+}
+
+static bool read_inputs(Reader *reader, BuildGraph *graph) {
+    uint32_t count = read_u32(reader);
+
+    for (uint32_t i = 0; i < count && reader->ok; i++) {
+        GraphInput input;
+        input.kind = read_u32(reader);
+        input.path = read_string(reader);
+        input.mtime = read_i64(reader);
+        input.hash = read_hash(reader);
+
+        if (!input.path) {
+            reader->ok = false;
+            break;
+        }
+
+        arena_push(&graph->arena, &graph->inputs, input);
+
+        // stop at the first change, the rest of the snapshot is useless
+        if (!input_unchanged(&input)) {
+            return false;
+        }
+    }
+
+    return reader->ok;
+}
+
+// Read a list of paths owned by the graph.
+static void read_paths(Reader *reader, BuildGraph *graph, Paths *paths) {
+    uint32_t count = read_u32(reader);
+
+    for (uint32_t i = 0; i < count && reader->ok; i++) {
+        char *path = read_string(reader);
+
+        if (!path) {
+            reader->ok = false;
+            break;
+        }
+
+        arena_push(&graph->arena, paths,
+                   string_table_adopt(&graph->strings, path));
+    }
+}
+
+static bool read_packages(Reader *reader, BuildGraph *graph) {
+    uint32_t count = read_u32(reader);
+
+    for (uint32_t i = 0; i < count && reader->ok; i++) {
+        BuildPackage *package =
+            arena_alloc(&graph->arena, sizeof(BuildPackage));
+        package->name = read_string(reader);
+        package->cflags = read_string(reader);
+        package->libs = read_string(reader);
+        package->links = read_string(reader);
+
+        vec_init(&package->files);
+        read_paths(reader, graph, &package->files);
+
+        arena_push(&graph->arena, &graph->packages, package);
+
+        if (!package->name || !package->cflags || !package->libs ||
+            !package->links) {
+            reader->ok = false;
+        } else {
+            map_put(&graph->package_names, package->name, package);
+        }
+    }
+
+    return reader->ok;
+}
+
+// A dependency whose target is resolved once every node is read.
+typedef struct {
+    BuildDep *dep;
+    uint32_t target;
+} DepFixup;
+
+typedef Vec(DepFixup) DepFixups;
+
+static void read_target(Reader *reader, BuildGraph *graph,
+                        BuildTarget *target, DepFixups *fixups) {
+    target->name = read_string(reader);
+    target->output = read_u32(reader);
+    target->warn = read_u32(reader);
+    target->lang = read_u32(reader);
+    target->std = read_u32(reader);
+
+    vec_init(&target->sources);
+    vec_init(&target->includes);
+    vec_init(&target->packages);
+    vec_init(&target->deps);
+
+    if (!target->name) {
+        reader->ok = false;
+        target->name = "";
+    }
+
+    read_paths(reader, graph, &target->sources);
+    read_paths(reader, graph, &target->includes);
+
+    uint32_t packages = read_u32(reader);
+
+    for (uint32_t i = 0; i < packages && reader->ok; i++) {
+        uint32_t index = read_u32(reader);
+
+        if (index >= graph->packages.len) {
+            reader->ok = false;
+            break;
+        }
+
+        arena_push(&graph->arena, &target->packages,
+                   graph->packages.data[index]);
+    }
+
+    uint32_t deps = read_u32(reader);
+
+    for (uint32_t i = 0; i < deps && reader->ok; i++) {
+        char *url = read_string(reader);
+        char *name = read_string(reader);
+        uint32_t node = read_u32(reader);
+        uint32_t dep_target = read_u32(reader);
+
+        if (!url || !name || node >= graph->nodes.len) {
+            reader->ok = false;
+            break;
+        }
+
+        BuildDep *dep = arena_alloc(&graph->arena, sizeof(BuildDep));
+        build_dep_init(dep, &graph->arena, url, name);
+        dep->node = graph->nodes.data[node];
+
+        arena_push(&graph->arena, &target->deps, dep);
+
+        DepFixup fixup = {.dep = dep, .target = dep_target};
+        vec_push(fixups, fixup);
+    }
+}
+
+static bool read_nodes(Reader *reader, BuildGraph *graph) {
+    uint32_t count = read_u32(reader);
+    uint32_t root = read_u32(reader);
+
+    if (!reader->ok || root >= count) {
+        return false;
+    }
+
+    // nodes are referred to by deps before they are read
+    for (uint32_t i = 0; i < count; i++) {
+        BuildNode *node = arena_alloc(&graph->arena, sizeof(BuildNode));
+        build_node_init(node);
+        arena_push(&graph->arena, &graph->nodes, node);
+    }
+
+    graph->root = graph->nodes.data[root];
+
+    DepFixups fixups;
+    vec_init(&fixups);
+
+    vec_foreach(&graph->nodes, node) {
+        uint32_t targets = read_u32(reader);
+
+        for (uint32_t i = 0; i < targets && reader->ok; i++) {
+            BuildTarget target;
+            read_target(reader, graph, &target, &fixups);
+            build_node_add_target(node, &graph->arena, target);
+        }
+    }
+
+    vec_foreach(&fixups, fixup) {
+        BuildNode *node = fixup.dep->node;
+
+        if (fixup.target >= node->targets.len) {
+            reader->ok = false;
+            break;
+        }
+
+        fixup.dep->target = &node->targets.data[fixup.target];
+    }
+
+    vec_free(&fixups);
+
+    return reader->ok;
+}
+
+bool graph_snapshot_load(BuildGraph *graph, const char *path) {
+    build_graph_init(graph);
+
+    char *data;
+    size_t size;
+
+    if (!file_exists(path) || !read_file_size(path, &data, &size)) {
+        return false;
+    }
+
+    Reader reader = {
+        .data = data,
+        .size = size,
+        .pos = 0,
+        .ok = true,
+        .arena = &graph->arena,
+    };
+
+    char magic[8];
+    read_bytes(&reader, magic, sizeof(magic));
+
+    uint32_t version = read_u32(&reader);
+    read_u32(&reader);
+    Hash environment = read_hash(&reader);
+
+    bool success = reader.ok &&
+                   memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0 &&
+                   version == SNAPSHOT_VERSION &&
+                   hash_equal(environment, environment_hash()) &&
+                   read_inputs(&reader, graph) &&
+                   read_packages(&reader, graph) && read_nodes(&reader, graph);
+
+    free(data);
+
+    if (!success) {
+        build_graph_free(graph);
+        build_graph_init(graph);
+    }
+
+    return success;
+}
+
+static uint32_t package_index(const BuildGraph *graph,
+                              const BuildPackage *package) {
+    for (size_t i = 0; i < graph->packages.len; i++) {
+        if (graph->packages.data[i] == package) {
+            return i;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+static uint32_t node_index(const BuildGraph *graph, const BuildNode *node) {
+    for (size_t i = 0; i < graph->nodes.len; i++) {
+        if (graph->nodes.data[i] == node) {
+            return i;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+static void write_target(FILE *file, const BuildGraph *graph,
+                         const BuildTarget *target) {
+    write_string(file, target->name);
+    write_u32(file, target->output);
+    write_u32(file, target->warn);
+    write_u32(file, target->lang);
+    write_u32(file, target->std);
+
+    write_u32(file, target->sources.len);
+    vec_foreach(&target->sources, source) write_string(file, source);
+
+    write_u32(file, target->includes.len);
+    vec_foreach(&target->includes, include) write_string(file, include);
+
+    write_u32(file, target->packages.len);
+    vec_foreach(&target->packages, package) {
+        write_u32(file, package_index(graph, package));
+    }
+
+    write_u32(file, target->deps.len);
+    vec_foreach(&target->deps, dep) {
+        write_string(file, dep->url);
+        write_string(file, dep->name);
+        write_u32(file, node_index(graph, dep->node));
+        write_u32(file, dep->target - dep->node->targets.data);
+    }
+}
+
+bool graph_snapshot_save(const BuildGraph *graph, const char *path) {
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp%d", path, (int)getpid());
+
+    FILE *file = fopen(tmp, "wb");
+
+    if (!file) {
+        return false;
+    }
+
+    fwrite(SNAPSHOT_MAGIC, 1, 8, file);
+    write_u32(file, SNAPSHOT_VERSION);
+    write_u32(file, 0);
+    write_hash(file, environment_hash());
+
+    write_u32(file, graph->inputs.len);
+    vec_foreachat(&graph->inputs, input) {
+        write_u32(file, input->kind);
+        write_string(file, input->path);
+        write_i64(file, input->mtime);
+        write_hash(file, input->hash);
+    }
+
+    write_u32(file, graph->packages.len);
+    vec_foreach(&graph->packages, package) {
+        write_string(file, package->name);
+        write_string(file, package->cflags);
+        write_string(file, package->libs);
+        write_string(file, package->links);
+
+        write_u32(file, package->files.len);
+        vec_foreach(&package->files, path) write_string(file, path);
+    }
+
+    write_u32(file, graph->nodes.len);
+    write_u32(file, node_index(graph, graph->root));
+    vec_foreach(&graph->nodes, node) {
+        write_u32(file, node->targets.len);
+        vec_foreachat(&node->targets, target) write_target(file, graph, target);
+    }
+
+    bool success = !ferror(file);
+    success = fclose(file) == 0 && success;
+
+    if (!success || rename(tmp, path) != 0) {
+        remove(tmp);
+        return false;
+    }
+
+    stat_cache_forget(path);
+
+    return true;
+}
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
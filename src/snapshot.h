@@ -0,0 +1,40 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "graph.h"
+
+// A snapshot of a resolved build graph.
+//
+// Loading a graph runs every build script, pkg-config for every package and
+// scans every source directory. A snapshot stores the result along with the
+// inputs of the graph, ie. the content of the build scripts, the times of the
+// scanned directories and .pc files, and the environment variables used. As
+// long as none of those changed, the graph is loaded from the snapshot.
+
+// Load a graph from a snapshot.
+//
+// Returns false if there is no snapshot, or if any of its inputs changed.
+bool graph_snapshot_load(BuildGraph *graph, const char *path);
+
+// Save a snapshot of a loaded graph and its inputs.
+bool graph_snapshot_save(const BuildGraph *graph, const char *path);
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
@@ -0,0 +1,176 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#include "task.h"
+#include "fs.h"
+#include "jobs.h"
+#include "log.h"
+
+void task_graph_init(TaskGraph *graph) {
+    vec_init(&graph->tasks);
+    graph->context = NULL;
+}
+
+void task_graph_free(TaskGraph *graph) {
+    vec_foreach(&graph->tasks, task) {
+        free(task->message);
+        free(task->error);
+        free(task->output);
+        args_free(&task->args);
+        args_free(&task->inputs);
+        vec_free(&task->deps);
+        vec_free(&task->dependents);
+        free(task);
+    }
+
+    vec_free(&graph->tasks);
+}
+
+Task *task_graph_add(TaskGraph *graph, Args args, const char *message,
+                     const char *error) {
+    Task *task = malloc(sizeof(Task));
+
+    task->message = message ? strdup(message) : NULL;
+    task->error = strdup(error);
+    task->args = args;
+    task->output = NULL;
+    task->inputs = args_new();
+    task->finish = NULL;
+    task->pending = 0;
+    task->state = TASK_WAITING;
+
+    vec_init(&task->deps);
+    vec_init(&task->dependents);
+
+    vec_push(&graph->tasks, task);
+
+    return task;
+}
+
+void task_depend(Task *task, Task *dep) {
+    vec_push(&task->deps, dep);
+    vec_push(&dep->dependents, task);
+    task->pending++;
+}
+
+// Mark a task as done and queue the dependents that are now ready.
+static void task_finish(Task *task, Tasks *ready) {
+    task->state = TASK_DONE;
+
+    vec_foreach(&task->dependents, dependent) {
+        if (--dependent->pending == 0) {
+            dependent->state = TASK_READY;
+            vec_push(ready, dependent);
+        }
+    }
+}
+
+bool task_graph_run(TaskGraph *graph, size_t jobs, bool verbose) {
+    Tasks ready;
+    vec_init(&ready);
+
+    vec_foreach(&graph->tasks, task) {
+        if (task->pending == 0) {
+            task->state = TASK_READY;
+            vec_push(&ready, task);
+        }
+    }
+
+    JobPool pool;
+    job_pool_init(&pool, jobs);
+
+    // ready tasks are started in the order they became ready
+    size_t next = 0;
+    bool failed = false;
+
+    while (true) {
+        // start as many ready tasks as there are free jobs
+        while (!failed && next < ready.len && !job_pool_full(&pool)) {
+            Task *task = ready.data[next++];
+
+            if (task->args.len == 0) {
+                task_finish(task, &ready);
+                continue;
+            }
+
+            if (task->message) {
+                INFO("%s\n", task->message);
+            }
+
+            if (verbose) {
+                INFO("Executing: ");
+                args_print(stderr, &task->args);
+            }
+
+            if (!job_pool_spawn(&pool, &task->args, PROCESS_INHERIT, NULL,
+                                task)) {
+                ERROR("Error: %s\n", task->error);
+                task->state = TASK_FAILED;
+                failed = true;
+                break;
+            }
+
+            task->state = TASK_RUNNING;
+        }
+
+        void *data;
+        int code;
+
+        if (!job_pool_wait_any(&pool, &data, &code)) {
+            break;
+        }
+
+        Task *task = data;
+
+        if (code != 0) {
+            ERROR("Error: %s\n", task->error);
+            task->state = TASK_FAILED;
+            failed = true;
+            continue;
+        }
+
+        // the output has just been written
+        if (task->output) {
+            stat_cache_forget(task->output);
+        }
+
+        if (task->finish && !task->finish(task, graph->context)) {
+            ERROR("Error: %s\n", task->error);
+            task->state = TASK_FAILED;
+            failed = true;
+            continue;
+        }
+
+        task_finish(task, &ready);
+    }
+
+    // a task is only left waiting if its dependencies form a cycle
+    vec_foreach(&graph->tasks, task) {
+        if (!failed && task->state != TASK_DONE) {
+            ERROR("Error: %s, its dependencies never finished\n",
+                  task->error);
+            failed = true;
+        }
+    }
+
+    job_pool_free(&pool);
+    vec_free(&ready);
+
+    return !failed;
+}
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
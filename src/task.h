@@ -0,0 +1,101 @@
+// Copyright (C) 2024  Hjalte C. Nannestad
+// See end of file for license information.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "args.h"
+
+typedef enum {
+    TASK_WAITING,
+    TASK_READY,
+    TASK_RUNNING,
+    TASK_DONE,
+    TASK_FAILED,
+} TaskState;
+
+typedef struct Task Task;
+typedef Vec(Task *) Tasks;
+
+// Called after the command of a task has succeeded.
+//
+// Returning false fails the task.
+typedef bool (*TaskFinish)(Task *task, void *context);
+
+// A single step of a build, eg. compiling an object or linking a binary.
+typedef struct Task {
+    // The message printed when the task starts, may be NULL.
+    char *message;
+
+    // The message printed when the task fails.
+    char *error;
+
+    // The command to run.
+    //
+    // If empty, the task finishes as soon as its dependencies have finished.
+    Args args;
+
+    // The file produced by the task, may be NULL.
+    char *output;
+
+    // The files read by the task, besides the outputs of its dependencies.
+    Args inputs;
+
+    // Called when the command has succeeded, may be NULL.
+    TaskFinish finish;
+
+    // The tasks that have to finish before this task can start.
+    Tasks deps;
+
+    // The tasks that depend on this task.
+    Tasks dependents;
+
+    // The number of dependencies that have not finished yet.
+    size_t pending;
+
+    TaskState state;
+} Task;
+
+// A graph of tasks.
+typedef struct {
+    Tasks tasks;
+
+    // The context passed to the finish callbacks of tasks.
+    void *context;
+} TaskGraph;
+
+void task_graph_init(TaskGraph *graph);
+void task_graph_free(TaskGraph *graph);
+
+// Add a task to the graph.
+//
+// The graph takes ownership of the arguments.
+Task *task_graph_add(TaskGraph *graph, Args args, const char *message,
+                     const char *error);
+
+// Make `task` wait for `dep` to finish.
+void task_depend(Task *task, Task *dep);
+
+// Run all tasks of the graph, running at most `jobs` commands at once.
+//
+// Every task whose dependencies have finished is started as soon as a job is
+// available. If a task fails no new tasks are started, and running tasks are
+// waited for. Returns true if all tasks succeeded.
+bool task_graph_run(TaskGraph *graph, size_t jobs, bool verbose);
+
+// This file is part of Lute.
+// Copyright (C) 2024  Hjalte C. Nannestad
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.